@@ -27,7 +27,7 @@ def main():
         # Wait for server's response on creation/joining
         while True:
             server_response = client_socket.recv(1024).decode()
-            print("Server response:", server_response)
+            print("Server response:", server_response, end="")
             if "All players have joined" in server_response:
                 break
             elif "No available lobby to join" in server_response:
@@ -52,7 +52,7 @@ def main():
             # Block and wait for the other player's response
             print("Waiting for your opponent")
             server_response = client_socket.recv(1024).decode()
-            print("Server response:", server_response)
+            print("Server response:", server_response, end="")
 
             waiting_for_result = False  
 
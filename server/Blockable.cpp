@@ -3,6 +3,7 @@
 #include "errno.h"
 #include <iostream>
 #include "stdio.h"
+#include <poll.h>
 
 namespace Sync{
 	
@@ -22,6 +23,12 @@ PipeUser::PipeUser (PipeUser const &p)
     ;
 }
 
+PipeUser::PipeUser (PipeUser &&p) noexcept
+    : Blockable(std::move(p)), sender(p.sender)
+{
+    p.sender = -1;
+}
+
 void PipeUser::Assign(PipeUser const & p)
 {
     close(sender);
@@ -36,6 +43,20 @@ PipeUser & PipeUser::operator = (PipeUser const & p)
     return *this;
 }
 
+PipeUser & PipeUser::operator = (PipeUser && p) noexcept
+{
+    if (this != &p)
+    {
+        close(sender);
+        close(GetFD());
+        SetFD(p.GetFD());
+        sender = p.sender;
+        p.SetFD(-1);
+        p.sender = -1;
+    }
+    return *this;
+}
+
 PipeUser::~PipeUser ()
 {
     close(sender);
@@ -150,34 +171,24 @@ void ShowParams(std::vector<Blockable *> const & v, int maxArg)
 
 //
 const int FlexWait::FOREVER = -1;
+const int FlexWait::POLL = 0;
 Blockable * FlexWait::Wait(int timeout)
 {
-    timeval tv;
-    int maxFD = 0;
-    int fd = 0;
-    tv.tv_sec = timeout/1000;
-    tv.tv_usec = (timeout%1000)*1000;
-    timeval * pTimeout = &tv;
-
-    if (timeout == -1)
-        pTimeout = 0;
-
-    fd_set theSet;
-    FD_ZERO(&theSet);
+    // poll() rather than select(): descriptors above FD_SETSIZE are common
+    // once every spectator connection holds a socket and an Event pipe.
+    std::vector<pollfd> fds(v.size());
     for (int i=0;i<v.size();i++)
     {
-        fd = v[i]->GetFD();
-        maxFD = std::max(maxFD,fd);
-        FD_SET(fd,&theSet);
+        fds[i].fd = v[i]->GetFD();
+        fds[i].events = POLLIN;
+        fds[i].revents = 0;
     }
-    int maxFDArg = maxFD+1;
-    //ShowParams(v,maxFDArg);
-    int selectionFD = select(maxFDArg, &theSet, NULL, NULL, pTimeout);
+    int selectionFD = poll(fds.data(), fds.size(), timeout);
 
     if (selectionFD < 0)
     {
-        perror("select");
-        ShowParams(v,maxFDArg);
+        perror("poll");
+        ShowParams(v,fds.size());
         throw std::string("Unexpected error in synchronization object");
     }
 
@@ -186,8 +197,7 @@ Blockable * FlexWait::Wait(int timeout)
 
     for (int i=0;i<v.size();i++)
     {
-        int fd = v[i]->GetFD();
-        if (FD_ISSET(fd,&theSet))
+        if (fds[i].revents & (POLLIN | POLLHUP | POLLERR | POLLNVAL))
             return v[i];
     }
     throw std::string("Unknown error in synchronization object");
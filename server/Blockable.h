@@ -10,6 +10,7 @@
 #include <sys/time.h>
 #include <unistd.h>
 #include <stdarg.h>
+#include <utility>
 
 namespace Sync {
 	
@@ -22,6 +23,7 @@ protected:
 public:
     Blockable(int f=0):fd(f){;}
     Blockable(Blockable const & b) : fd(dup(b.fd)){;}
+    Blockable(Blockable && b) noexcept : fd(b.fd){b.fd = -1;}
     virtual ~Blockable(void){;}
     operator int(void)const {return fd;}
     void SetFD(int f){fd =f;}
@@ -39,7 +41,9 @@ private:
 protected:
     PipeUser(void);
     PipeUser(PipeUser const &);
+    PipeUser(PipeUser &&) noexcept;
     PipeUser & operator=(PipeUser const &);
+    PipeUser & operator=(PipeUser &&) noexcept;
     void Assign(PipeUser const &);
     ~PipeUser(void);
     void BlockForByte(void);
@@ -53,7 +57,9 @@ public:
     Event(void){;}
     ~Event(){;}
     Event (Event const &);
+    Event (Event && e) noexcept : PipeUser(std::move(e)){;}
     Event & operator=(Event const &);
+    Event & operator=(Event && e) noexcept {PipeUser::operator=(std::move(e)); return *this;}
     void Trigger(void);
     void Wait(void);
     void Reset(void);
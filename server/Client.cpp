@@ -4,10 +4,11 @@
 
 using namespace Sync;
 
-int main() {
+int main(int argc, char *argv[]) {
     try {
         std::cout << "I am a client" << std::endl;
-        Socket client("127.0.0.1", 3000);
+        // Optional endpoint, e.g. "[::1]:3000" or "seqpacket:/tmp/rps.sock"
+        Socket client(argc > 1 ? Endpoint::Parse(argv[1]) : Endpoint::Inet("127.0.0.1", 3000));
 		client.Open();
 
         while (true) {
@@ -36,7 +37,8 @@ int main() {
 				std::cout << "Connection to server lost. Client terminated gracefully." << std::endl;
 				break;
             }
-            std::cout << "Server response: " << response.ToString() << std::endl;
+            // Every message from the server already ends in a newline
+            std::cout << "Server response: " << response.ToString() << std::flush;
         }
     } catch (const std::string &error) {
         std::cerr << "Error: " << error << std::endl;
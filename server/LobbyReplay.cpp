@@ -0,0 +1,204 @@
+#include "lobbyengine.h"
+#include "trace.h"
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <memory>
+
+using namespace Protocol;
+
+// Drives LobbyEngine single-threaded, either from a trace recorded by
+// "Server --record" or from a stream of random events, and checks the
+// engine's invariants after every event.
+//
+//     LobbyReplay <trace>
+//     LobbyReplay --fuzz <events> [seed] [--save <trace>]
+
+struct Totals {
+    size_t events = 0;
+    size_t messages = 0;
+    size_t results = 0;
+};
+
+// Counts what the engine sends and rejects messages addressed to empty slots.
+class CheckingOutput : public LobbyOutput {
+public:
+    CheckingOutput(Totals &t) : totals(t), engine(nullptr), lastRound(0) {
+    }
+
+    void Attach(const LobbyEngine *e) {
+        engine = e;
+    }
+
+    void SendStatus(int playerId, Status status, int argument) override {
+        Check(playerId);
+        totals.messages++;
+    }
+
+    void SendSession(int playerId, uint64_t session) override {
+        Check(playerId);
+        totals.messages++;
+    }
+
+    void SendResult(const ResultRecord &record) override {
+        if (record.round != lastRound + 1) {
+            throw std::string("Result rounds are not consecutive");
+        }
+        lastRound = record.round;
+        totals.results++;
+    }
+
+private:
+    Totals &totals;
+    const LobbyEngine *engine;
+    uint32_t lastRound;
+
+    void Check(int playerId) {
+        if (!engine->IsPresent(playerId)) {
+            throw std::string("Message sent to player " + std::to_string(playerId) + " who is not in the lobby");
+        }
+    }
+};
+
+struct ReplayLobby {
+    CheckingOutput output;
+    LobbyEngine engine;
+    std::vector<uint64_t> sessions;  // Handed out in this lobby, for the fuzzer to resume
+
+    ReplayLobby(int lobbyId, Totals &totals, TraceRecorder *recorder)
+        : output(totals), engine(lobbyId, output, recorder) {
+        output.Attach(&engine);
+    }
+};
+
+void Report(const Totals &totals, size_t lobbies, std::chrono::steady_clock::time_point started) {
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    std::cout << totals.events << " events across " << lobbies << " lobbies, "
+              << totals.results << " results, " << totals.messages << " messages in "
+              << seconds << "s (" << (size_t)(totals.events / (seconds > 0 ? seconds : 1e-9)) << " events/s)" << std::endl;
+}
+
+int Replay(const std::string &path) {
+    TraceReader reader(path);
+    Totals totals;
+    std::unordered_map<int, std::unique_ptr<ReplayLobby>> lobbies;
+    auto started = std::chrono::steady_clock::now();
+
+    LobbyEvent event;
+    while (reader.Next(event)) {
+        auto &lobby = lobbies[event.lobbyId];
+        if (!lobby) {
+            lobby = std::make_unique<ReplayLobby>(event.lobbyId, totals, nullptr);
+        }
+        try {
+            lobby->engine.Apply(event);
+            lobby->engine.CheckInvariants();
+        } catch (const std::string &error) {
+            std::cerr << "Event " << totals.events << " (lobby " << event.lobbyId << ", type "
+                      << (int)event.type << "): " << error << std::endl;
+            return 1;
+        }
+        totals.events++;
+    }
+    Report(totals, lobbies.size(), started);
+    return 0;
+}
+
+int Fuzz(size_t count, uint64_t seed, const std::string &savePath) {
+    const int lobbyCount = 64;
+    std::mt19937_64 random(seed);
+    Totals totals;
+    std::unique_ptr<TraceRecorder> recorder;
+    if (!savePath.empty()) {
+        recorder = std::make_unique<TraceRecorder>(savePath);
+    }
+    std::vector<std::unique_ptr<ReplayLobby>> lobbies;
+    for (int i = 1; i <= lobbyCount; i++) {
+        lobbies.push_back(std::make_unique<ReplayLobby>(i, totals, recorder.get()));
+    }
+
+    uint64_t nextSession = 1;
+    auto started = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < count; i++) {
+        ReplayLobby &lobby = *lobbies[random() % lobbyCount];
+        uint64_t roll = random();
+        // Mostly valid player ids, with the occasional out of range one
+        int playerId = (roll >> 8) % 50 == 0 ? (int)((roll >> 16) % 4) : 1 + (int)((roll >> 16) & 1);
+
+        LobbyEvent event;
+        event.lobbyId = lobby.engine.GetLobbyId();
+        event.playerId = playerId;
+        unsigned kind = roll % 100;
+        if (kind < 15) {
+            event.type = LobbyEvent::Join;
+            event.session = nextSession++;
+            if (lobby.sessions.size() < 8) {
+                lobby.sessions.push_back(event.session);
+            } else {
+                lobby.sessions[(roll >> 24) % 8] = event.session;
+            }
+        } else if (kind < 70) {
+            event.type = LobbyEvent::Choose;
+            event.move = (Move)((roll >> 32) % 5);  // Includes None and one out of range value
+        } else if (kind < 78) {
+            event.type = LobbyEvent::Leave;
+        } else if (kind < 88) {
+            event.type = LobbyEvent::Disconnect;
+        } else if (kind < 98) {
+            event.type = LobbyEvent::Resume;
+            event.session = lobby.sessions.empty() ? 0 : lobby.sessions[(roll >> 40) % lobby.sessions.size()];
+        } else {
+            event.type = LobbyEvent::Resolve;
+        }
+
+        try {
+            lobby.engine.Apply(event);
+            lobby.engine.CheckInvariants();
+        } catch (const std::string &error) {
+            std::cerr << "Seed " << seed << ", event " << i << " (lobby " << event.lobbyId << ", type "
+                      << (int)event.type << "): " << error << std::endl;
+            if (recorder) {
+                recorder->Flush();
+                std::cerr << "Trace saved to " << savePath << std::endl;
+            }
+            return 1;
+        }
+        totals.events++;
+    }
+    Report(totals, lobbies.size(), started);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    try {
+        std::string mode = argc > 1 ? argv[1] : "";
+        if (mode == "--fuzz" && argc > 2) {
+            size_t count = std::stoull(argv[2]);
+            uint64_t seed = std::random_device()();
+            std::string savePath;
+            for (int i = 3; i < argc; i++) {
+                std::string option = argv[i];
+                if (option == "--save" && i + 1 < argc) {
+                    savePath = argv[++i];
+                } else {
+                    seed = std::stoull(option);
+                }
+            }
+            std::cout << "Fuzzing with seed " << seed << std::endl;
+            return Fuzz(count, seed, savePath);
+        } else if (argc == 2 && mode[0] != '-') {
+            return Replay(mode);
+        }
+        std::cerr << "Usage: " << argv[0] << " <trace> | --fuzz <events> [seed] [--save <trace>]" << std::endl;
+        return 1;
+    } catch (const std::string &error) {
+        std::cerr << "Error: " << error << std::endl;
+        return 1;
+    } catch (const std::exception &error) {
+        std::cerr << "Error: " << error.what() << std::endl;
+        return 1;
+    }
+}
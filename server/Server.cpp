@@ -1,4 +1,16 @@
 #include "socketserver.h"
+#include "broadcast.h"
+#include "protocol.h"
+#include "session.h"
+#include "tls.h"
+#include "lobbyengine.h"
+#include "trace.h"
+#include "scheduler.h"
+#include "bot.h"
+#include "ratelimit.h"
+#include "log.h"
+#include "stats.h"
+#include "profile.h"
 #include <iostream>
 #include <algorithm>
 #include <thread>
@@ -7,49 +19,98 @@
 #include <mutex>
 #include <unordered_map>
 #include <memory>
+#include <sstream>
 
 using namespace Sync;
+using namespace Protocol;
 
 std::atomic<bool> terminateServer(false);  // Global atomic flag to control server termination
 
+SessionTable sessions(std::chrono::seconds(30));  // Grace window for dropped players to resume
+std::unique_ptr<TlsContext> tlsContext;  // Set when the server is started with --tls
+std::unique_ptr<TraceRecorder> recorder;  // Set when the server is started with --record
+std::unique_ptr<Scheduler> scheduler;  // Worker pool for bots and other short tasks
+std::chrono::seconds botDelay(15);  // How long a lone player waits before a bot joins, 0 for never
+std::atomic<uint64_t> botSeeds(0x2545F4914F6CDD1Dull);
+Rate connectionMessages{20, 10};  // Requests one connection may send: burst, then per second
+SourceLimiter limiter(SourceLimiter::Limits{
+    {10, 2},     // New connections per address: burst, then per second
+    {60, 20},    // Requests per address across all its connections
+    32,          // Concurrent connections per address
+    10000});     // Concurrent connections overall
+LatencyHistogram requestLatency;  // From a player's request arriving to the lobby having applied it
+LockStats playersLockStats("playersMutex");  // Shared by every lobby's playersMutex
+LockStats lobbiesLockStats("lobbiesMutex");
 
-class Lobby {
+void RetireLobby(int lobbyId);
+
+class Lobby : public LobbyOutput, public std::enable_shared_from_this<Lobby> {
 public:
-    Lobby() : running(true), lobbyId(GetNextLobbyId()) {
-        // Constructor no longer starts the thread
-    }
+    // What the admin socket shows for a lobby, read without taking playersMutex.
+    struct Summary {
+        int lobbyId;
+        std::chrono::steady_clock::duration age;
+        int players;
+        int bots;
+        int disconnected;
+        uint32_t round;
+    };
 
-    void Start() {
-        if (!running) {
-            std::cout << "Lobby is already stopped or has not started yet." << std::endl;
-            return;
-        }
-        lobbyThread = std::thread(&Lobby::lobbyThreadFunction, this);
+    Lobby() : playersMutex(playersLockStats), running(true), lobbyId(GetNextLobbyId()), created(std::chrono::steady_clock::now()), packedSummary(0),
+              engine(lobbyId, *this, recorder.get()),
+              textSpectators(std::make_shared<SpectatorHub>()),
+              binarySpectators(std::make_shared<SpectatorHub>()) {
     }
 
     virtual ~Lobby() {
-        if (running) {
-            running = false;
-            if (lobbyThread.joinable()) {
-                lobbyThread.join();
-            }
-        }
+        textSpectators->Close();
+        binarySpectators->Close();
+        running = false;
     }
 
-    bool AddPlayer(Socket player) {
-        std::lock_guard<std::mutex> lock(playersMutex);
-        if (players.size() < 2) {
-            players.push_back(std::move(player));
-            std::cout << "Player successfully added. Total players now: " << players.size() << std::endl;
-            return true;
-        } else {
-            std::cerr << "Lobby is full. Cannot add more players." << std::endl;
+    bool AddPlayer(std::shared_ptr<Connection> player) {
+        PlayersLock lock(*this, __func__);
+        if (engine.IsFull()) {
+            Log(LogLevel::Warning) << "Lobby is full. Cannot add more players.";
             return false;
         }
+        // The engine always seats a new player in the first free slot
+        int playerId = 1;
+        while (engine.IsPresent(playerId)) {
+            playerId++;
+        }
+        connections[playerId - 1] = player;
+        tokens[playerId - 1] = sessions.Issue(lobbyId);
+        engine.Join(tokens[playerId - 1].tag);
+        Log(LogLevel::Info) << "Player successfully added. Total players now: " << engine.PlayerCount();
+        if (engine.IsFull()) {
+            LaunchPlayerThreads();
+        } else {
+            ScheduleBotFill();
+        }
+        PublishSummary();
+        return true;
     }
 
-    size_t PlayerCount() const {
-        return players.size();
+    // Seats a bot if a player has been waiting alone for the whole bot delay.
+    void FillWithBot() {
+        PlayersLock lock(*this, __func__);
+        if (engine.IsFull() || engine.PlayerCount() == 0 ||
+            std::chrono::steady_clock::now() - waitingSince < botDelay) {
+            return;
+        }
+        int playerId = 1;
+        while (engine.IsPresent(playerId)) {
+            playerId++;
+        }
+        // Bots never resume, so their sessions live outside the session table
+        uint64_t seed = botSeeds.fetch_add(0x9E3779B97F4A7C15ull);
+        bots[playerId - 1] = std::make_shared<Bot>(playerId, seed);
+        tokens[playerId - 1] = SessionToken();
+        Log(LogLevel::Info) << "Bot joined lobby " << lobbyId << " as player " << playerId;
+        engine.Join((1ull << 63) | (seed >> 1));
+        LaunchPlayerThreads();
+        PublishSummary();
     }
 
     int GetLobbyId() const {
@@ -60,200 +121,780 @@ public:
         return nextLobbyId.fetch_add(1, std::memory_order_relaxed);
     }
 
+    std::shared_ptr<SpectatorHub> Spectators(Wire wire) const {
+        return wire == Wire::Binary ? binarySpectators : textSpectators;
+    }
+
+    // Puts a new connection into a player's slot. The old connection may
+    // still look alive, e.g. half-open after a network blip, since nothing is
+    // written to an idle player; the token proves the new one is the player's,
+    // so it takes over and the old one is cut off.
+    bool ResumePlayer(const SessionToken &token, std::shared_ptr<Connection> player) {
+        PlayersLock lock(*this, __func__);
+        int playerId = FindSession(token.tag);
+        if (playerId == 0) {
+            return false;
+        }
+        if (engine.IsConnected(playerId)) {
+            if (connections[playerId - 1]) {
+                connections[playerId - 1]->Interrupt();  // Its reader finds the slot taken
+            }
+            engine.Disconnect(playerId);
+            readers[playerId - 1].reset();
+            Log(LogLevel::Info) << "Player " << playerId << " in lobby " << lobbyId << " replaced a stale connection";
+        }
+        connections[playerId - 1] = player;
+        engine.Resume(token.tag);
+        Log(LogLevel::Info) << "Player " << playerId << " resumed in lobby " << lobbyId;
+        if (engine.IsStarted()) {
+            LaunchPlayerThreads();
+        }
+        PublishSummary();
+        return true;
+    }
+
+    // Called once a dropped player's grace window has run out.
+    void DropPlayer(const SessionToken &token) {
+        PlayersLock lock(*this, __func__);
+        int playerId = FindSession(token.tag);
+        if (playerId != 0) {
+            RemovePlayer(playerId);
+        }
+    }
+
+    // Disconnects a player for good, as if they had said "done". Bots can be
+    // kicked too; the lobby then waits for another opponent.
+    bool Kick(int playerId) {
+        PlayersLock lock(*this, __func__);
+        if (playerId < 1 || playerId > LobbyEngine::MaxPlayers || !engine.IsPresent(playerId)) {
+            return false;
+        }
+        std::shared_ptr<Connection> connection = connections[playerId - 1];
+        bots[playerId - 1].reset();
+        RemovePlayer(playerId);
+        if (connection) {
+            connection->Interrupt();  // Wakes the player's reader thread, which finds its slot gone
+        }
+        Log(LogLevel::Info) << "Player " << playerId << " kicked from lobby " << lobbyId;
+        return true;
+    }
+
+    // Ends the current round now; players who have not chosen count as not responding.
+    bool ForceResolve() {
+        PlayersLock lock(*this, __func__);
+        uint32_t round = engine.Round();
+        engine.ForceResolve();
+        return engine.Round() != round;
+    }
+
+    Summary Describe() const {
+        uint64_t packed = packedSummary.load(std::memory_order_acquire);
+        return Summary{lobbyId, std::chrono::steady_clock::now() - created,
+                       (int)(packed & 0xFF), (int)((packed >> 8) & 0xFF), (int)((packed >> 16) & 0xFF),
+                       (uint32_t)(packed >> 32)};
+    }
+
+    // LobbyOutput, only called by the engine while playersMutex is held
+    void SendStatus(int playerId, Status status, int argument) override {
+        if (bots[playerId - 1] && status == Status::AllJoined) {
+            ScheduleBotMove(bots[playerId - 1]);
+        }
+        if (connections[playerId - 1]) {
+            connections[playerId - 1]->SendStatus(status, argument);
+        }
+    }
+
+    // The engine only knows the tag; the player needs the whole token
+    void SendSession(int playerId, uint64_t) override {
+        if (connections[playerId - 1]) {
+            connections[playerId - 1]->SendSession(tokens[playerId - 1]);
+        }
+    }
+
+    void SendResult(const ResultRecord &record) override {
+        TraceSpan span("SendResult", lobbyId);
+        // Encode the result once per wire format; players and spectators share the buffers
+        SharedBuffer text = std::make_shared<const ByteArray>(EncodeResult(Wire::Text, record));
+        SharedBuffer binary = std::make_shared<const ByteArray>(EncodeResult(Wire::Binary, record));
+        for (auto& connection : connections) {
+            if (connection) {
+                connection->Send(connection->GetWire() == Wire::Binary ? *binary : *text);
+            }
+        }
+        // Spectators get it once playersMutex is released; see PlayersLock
+        unpublished.push_back(Unpublished{record.round, text, binary});
+        for (auto& bot : bots) {
+            if (bot) {
+                bot->Observe(record);
+                ScheduleBotMove(bot);
+            }
+        }
+        PublishSummary();
+        Log(LogLevel::Debug) << "Lobby " << lobbyId << " round " << record.round << ": " << OutcomeText(record.outcome);
+    }
+
 private:
-    std::vector<Socket> players;
-    std::mutex playersMutex;
+    // A result waiting to go to spectators.
+    struct Unpublished {
+        uint32_t round;
+        SharedBuffer text;
+        SharedBuffer binary;
+    };
+
+    // Holds playersMutex. Results the engine produced meanwhile are handed to
+    // the spectator hubs after the mutex is released, so fan-out never runs
+    // under the game lock.
+    class PlayersLock {
+    public:
+        PlayersLock(Lobby &l, const char *site) : lobby(l), lock(l.playersMutex, site) {
+        }
+
+        ~PlayersLock() {
+            std::vector<Unpublished> results;
+            results.swap(lobby.unpublished);
+            bool emptied = lobby.emptied;
+            lobby.emptied = false;
+            lock.Unlock();
+            for (auto& result : results) {
+                lobby.textSpectators->Publish(result.round, result.text);
+                lobby.binarySpectators->Publish(result.round, result.binary);
+            }
+            // Takes lobbiesMutex, which ranks above playersMutex
+            if (emptied) {
+                RetireLobby(lobby.lobbyId);
+            }
+        }
+
+    private:
+        Lobby &lobby;
+        ProfiledLock lock;
+    };
+
+    ProfiledMutex playersMutex;
     std::atomic<bool> running;
-    std::thread lobbyThread;
     int lobbyId;
     static std::atomic<int> nextLobbyId;
+    std::chrono::steady_clock::time_point created;
+    std::atomic<uint64_t> packedSummary;  // round << 32 | disconnected << 16 | bots << 8 | players
+    LobbyEngine engine;  // Game rules; guarded by playersMutex
+    std::shared_ptr<Connection> connections[LobbyEngine::MaxPlayers];  // Indexed by player id - 1
+    std::shared_ptr<Connection> readers[LobbyEngine::MaxPlayers];  // Connections with a HandlePlayer thread
+    std::shared_ptr<Bot> bots[LobbyEngine::MaxPlayers];  // Slots played by the server
+    SessionToken tokens[LobbyEngine::MaxPlayers];  // Session of each seated person, empty for bots
+    std::chrono::steady_clock::time_point waitingSince;
+    // One hub per wire format so each result is encoded at most once per format.
+    // Shared so spectators can outlive the lobby.
+    std::shared_ptr<SpectatorHub> textSpectators;
+    std::shared_ptr<SpectatorHub> binarySpectators;
+    std::vector<Unpublished> unpublished;  // Guarded by playersMutex
+    bool emptied = false;  // The last player just left; guarded by playersMutex
 
-    void lobbyThreadFunction() {
-        std::lock_guard<std::mutex> lock(playersMutex);
-        std::cout << "Starting thread function with " << players.size() << " players." << std::endl;
-        int playerId = 1;
-        for (auto& player : players) {
-            const std::string message = "All players have joined";
-            player.Write(message);
-            std::cout << "Launching thread for player " << playerId << std::endl;
-            std::thread([this, &player, playerId]() {
-                HandlePlayer(player, playerId);
-            }).detach();
-            playerId++;
+    // Caller must hold playersMutex
+    void PublishSummary() {
+        uint64_t botCount = 0;
+        uint64_t disconnectedCount = 0;
+        for (int id = 1; id <= LobbyEngine::MaxPlayers; id++) {
+            botCount += bots[id - 1] ? 1 : 0;
+            disconnectedCount += engine.IsPresent(id) && !engine.IsConnected(id) ? 1 : 0;
+        }
+        packedSummary.store((uint64_t)engine.Round() << 32 | disconnectedCount << 16 | botCount << 8 |
+                            (uint64_t)engine.PlayerCount(), std::memory_order_release);
+    }
+
+    // Caller must hold playersMutex
+    int FindSession(uint64_t session) {
+        for (int playerId = 1; playerId <= LobbyEngine::MaxPlayers; playerId++) {
+            if (engine.IsPresent(playerId) && engine.Session(playerId) == session) {
+                return playerId;
+            }
+        }
+        return 0;
+    }
+
+    // Caller must hold playersMutex
+    void ScheduleBotFill() {
+        if (!scheduler || botDelay.count() == 0) {
+            return;
+        }
+        waitingSince = std::chrono::steady_clock::now();
+        std::weak_ptr<Lobby> self = shared_from_this();
+        scheduler->PostAfter(botDelay, [self]() {
+            if (auto lobby = self.lock()) {
+                lobby->FillWithBot();
+            }
+        });
+    }
+
+    // Caller must hold playersMutex
+    void ScheduleBotMove(const std::shared_ptr<Bot> &bot) {
+        std::weak_ptr<Lobby> self = shared_from_this();
+        scheduler->PostAfter(std::chrono::milliseconds(bot->ThinkTime()), [self, bot]() {
+            if (auto lobby = self.lock()) {
+                lobby->BotChoose(bot);
+            }
+        });
+    }
+
+    void BotChoose(const std::shared_ptr<Bot> &bot) {
+        TraceSpan span("BotChoose", lobbyId);
+        PlayersLock lock(*this, __func__);
+        int playerId = bot->GetPlayerId();
+        if (bots[playerId - 1] == bot) {
+            engine.Choose(playerId, bot->NextMove());
         }
-        std::cout << "\nAll player threads launched." << std::endl;
     }
 
-    void HandlePlayer(Socket playerSocket, int playerId) {
+    // Caller must hold playersMutex
+    void LaunchPlayerThreads() {
+        for (int playerId = 1; playerId <= LobbyEngine::MaxPlayers; playerId++) {
+            std::shared_ptr<Connection> player = connections[playerId - 1];
+            if (player && readers[playerId - 1] != player) {
+                readers[playerId - 1] = player;
+                Log(LogLevel::Debug) << "Launching thread for player " << playerId;
+                // The reader keeps the lobby alive after it is retired
+                std::shared_ptr<Lobby> self = shared_from_this();
+                std::thread([self, player, playerId]() {
+                    self->HandlePlayer(player, playerId);
+                }).detach();
+            }
+        }
+    }
+
+    void HandlePlayer(std::shared_ptr<Connection> player, int playerId) {
         while (running) {
-            ByteArray data;
-            int bytesRead = playerSocket.Read(data);
-            if (bytesRead > 0) {
-                std::string choice(data.v.begin(), data.v.end());
-                ProcessPlayerChoice(playerId, choice);
+            Request request;
+            if (player->ReadRequest(request)) {
+                auto received = std::chrono::steady_clock::now();
+                bool owned = ProcessPlayerChoice(player, playerId, request);
+                requestLatency.Record(std::chrono::steady_clock::now() - received);
+                if (!owned) {
+                    break;
+                }
             } else {
-                std::cerr << "Failed to read data or connection closed for player " << playerId << std::endl;
+                Log(LogLevel::Warning) << "Failed to read data or connection closed for player " << playerId;
+                PlayerDisconnected(player, playerId);
                 break;
             }
         }
     }
 
-    void ProcessPlayerChoice(int playerId, const std::string &choice) {
-        std::lock_guard<std::mutex> lock(playersMutex);
-        if (choice == "done") {
-            if (playerId - 1 < players.size()) {
-                players.erase(players.begin() + (playerId - 1));
-                std::cout << "Player " + std::to_string(playerId) + " has left the lobby." << std::endl;
-                const std::string leaveMessage = "Player " + std::to_string(playerId) + " has left the lobby.";
-                for (auto& player : players) {
-                    player.Write(leaveMessage);
+    // Returns false once this connection no longer owns the player's slot.
+    bool ProcessPlayerChoice(const std::shared_ptr<Connection> &player, int playerId, const Request &request) {
+        TraceSpan span("ProcessPlayerChoice", lobbyId);
+        PlayersLock lock(*this, __func__);
+        if (connections[playerId - 1] != player) {
+            return false;
+        }
+        if (request.command == Command::Done) {
+            RemovePlayer(playerId);
+            return false;
+        }
+        // Anything that is not a move is reported back as an invalid choice
+        engine.Choose(playerId, request.command == Command::Choice ? request.move : Move::None);
+        return true;
+    }
+
+    // Keep the slot open for the grace window instead of tearing the game down.
+    void PlayerDisconnected(const std::shared_ptr<Connection> &player, int playerId) {
+        PlayersLock lock(*this, __func__);
+        if (connections[playerId - 1] == player) {
+            sessions.Disconnected(tokens[playerId - 1]);
+            engine.Disconnect(playerId);
+            connections[playerId - 1].reset();
+            readers[playerId - 1].reset();
+            PublishSummary();
+        }
+    }
+
+    // Caller must hold playersMutex
+    void RemovePlayer(int playerId) {
+        if (engine.IsPresent(playerId)) {
+            sessions.Revoke(tokens[playerId - 1]);
+            tokens[playerId - 1] = SessionToken();
+            connections[playerId - 1].reset();
+            readers[playerId - 1].reset();
+            engine.Leave(playerId);
+            Log(LogLevel::Info) << "Player " << playerId << " has left lobby " << lobbyId;
+            // Bots only stay while there is a person to play against
+            bool humanLeft = false;
+            for (int id = 1; id <= LobbyEngine::MaxPlayers; id++) {
+                humanLeft = humanLeft || (engine.IsPresent(id) && !bots[id - 1]);
+            }
+            for (int id = 1; id <= LobbyEngine::MaxPlayers; id++) {
+                if (bots[id - 1] && !humanLeft) {
+                    bots[id - 1].reset();
+                    engine.Leave(id);
                 }
             }
-            playerChoices.erase(playerId);
-            return;
+            if (humanLeft && !engine.IsFull()) {
+                ScheduleBotFill();
+            }
+            PublishSummary();
+            emptied = engine.PlayerCount() == 0;
         }
-        if (IsValidChoice(choice)) {
-            playerChoices[playerId] = choice;
-            CheckAllPlayersChoices();
-        } else {
-            SendDataToPlayer(playerId, "Invalid choice. Try again.");
+    }
+};
+
+std::atomic<int> Lobby::nextLobbyId(1);  // Initialize static member
+
+std::unordered_map<int, std::shared_ptr<Lobby>> lobbies;  // Lobbies in operation
+ProfiledMutex lobbiesMutex(lobbiesLockStats);  // Protect access to the lobbies map
+// Copy of the lobbies for the admin socket, replaced whole under lobbiesMutex
+// and read with atomic_load so listing lobbies never waits on game traffic.
+typedef std::vector<std::shared_ptr<Lobby>> LobbyList;
+std::shared_ptr<const LobbyList> lobbySnapshot = std::make_shared<const LobbyList>();
+
+// Forgets a lobby once its last player has left and no session can bring one
+// back, so searches, listings and the snapshot only cover live lobbies. The
+// caller must not hold lobbiesMutex, and must hold a reference to the lobby
+// if it is running inside it.
+void RetireLobby(int lobbyId) {
+    ProfiledLock lock(lobbiesMutex, __func__);
+    auto it = lobbies.find(lobbyId);
+    // Joins and resumes run under lobbiesMutex, so the summary is current here
+    if (it == lobbies.end() || it->second->Describe().players != 0) {
+        return;
+    }
+    lobbies.erase(it);
+    auto snapshot = std::make_shared<LobbyList>();
+    for (auto& lobby : *std::atomic_load(&lobbySnapshot)) {
+        if (lobby->GetLobbyId() != lobbyId) {
+            snapshot->push_back(lobby);
         }
     }
+    std::atomic_store(&lobbySnapshot, std::shared_ptr<const LobbyList>(std::move(snapshot)));
+    Log(LogLevel::Info) << "Lobby " << lobbyId << " closed";
+}
 
-    bool IsValidChoice(const std::string &choice) {
-        return choice == "rock" || choice == "paper" || choice == "scissors";
+void HandleSpectator(std::shared_ptr<Connection> client, int lobbyId) {
+    if (lobbyId <= 0) {
+        client->SendStatus(Status::InvalidLobbyId);
+        return;
     }
 
-    void CheckAllPlayersChoices() {
-        if (playerChoices.size() == players.size()) {
-            std::string result = DetermineWinner();
-            std::string message = "The result is ";
-            message += result;
-            message += ", Good game!";
-            for (auto& player : players) {
-                player.Write(message);
-                std::cout << "Launching thread for player " << std::endl;
-            }
-            std::cout << result << std::endl;
-            playerChoices.clear();
-        }
-    }
-
-    std::string DetermineWinner() {
-        std::string choice1 = playerChoices[1];
-        std::string choice2 = playerChoices[2];
-        if (choice1 == choice2) {
-            return "Draw";
-        } else if ((choice1 == "rock" && choice2 == "scissors") ||
-                   (choice1 == "scissors" && choice2 == "paper") ||
-                   (choice1 == "paper" && choice2 == "rock")) {
-            return "Player 1 wins!";
-        } else if ((choice2 == "rock" && choice1 == "scissors") ||
-                   (choice2 == "scissors" && choice1 == "paper") ||
-                   (choice2 == "paper" && choice1 == "rock")) {
-            return "Player 2 wins!";
-        } else {
-            return "Both players did not respond.";
+    std::shared_ptr<SpectatorHub> hub;
+    {
+        ProfiledLock lock(lobbiesMutex, __func__);
+        auto it = lobbies.find(lobbyId);
+        if (it != lobbies.end()) {
+            hub = it->second->Spectators(client->GetWire());
         }
     }
+    if (!hub) {
+        client->SendStatus(Status::NoSuchLobby, lobbyId);
+        return;
+    }
 
-    void SendDataToPlayer(int playerId, const std::string &message) {
-        std::lock_guard<std::mutex> lock(playersMutex);
-        if (playerId - 1 < players.size()) {
-            try {
-                players[playerId - 1].Write(message);
-            } catch (const std::string &error) {
-                std::cerr << "Error sending data to player: " << error << std::endl;
-            }
+    SpectatorHub::Cursor cursor(hub);
+    client->SendStatus(Status::Spectating, lobbyId);
+    Log(LogLevel::Info) << "Spectator joined lobby " << lobbyId << " (" << hub->Count() << " watching)";
+    PumpSpectator(client->GetSocket(), cursor);
+    Log(LogLevel::Info) << "Spectator left lobby " << lobbyId << ", " << cursor.Dropped() << " results dropped";
+}
+
+void HandleClient(Socket socket, bool secure, std::shared_ptr<Admission> admission) {
+    auto client = std::make_shared<Connection>(std::move(socket));
+    client->Limit(connectionMessages, admission);
+    if (secure) {
+        // Handshake here rather than in the accept loop so a slow client only stalls its own thread
+        try {
+            TraceSpan span("TlsHandshake");
+            client->GetSocket().StartTls(*tlsContext);
+        } catch (const std::string &error) {
+            Log(LogLevel::Warning) << error;
+            return;
+        }
+        if (!client->GetSocket().IsKernelTls()) {
+            Log(LogLevel::Info) << "TLS connection established without kernel offload";
         }
     }
 
-    std::unordered_map<int, std::string> playerChoices; // Store player choices
-};
+    Request request;
+    if (!client->Negotiate() || !client->ReadRequest(request)) {
+        return;
+    }
 
-std::atomic<int> Lobby::nextLobbyId(1);  // Initialize static member
+    if (request.command == Command::Spectate) {
+        HandleSpectator(client, request.lobbyId);
+        return;
+    }
 
-std::unordered_map<int, std::unique_ptr<Lobby>> lobbies;  // Lobbies in operation
-std::mutex lobbiesMutex;  // Protect access to the lobbies map
+    TraceSpan span("Dispatch");  // Finding or creating the lobby and seating the player
 
-void HandleClient(Socket client) {
-    ByteArray data;
-    client.Read(data);
-    std::string choice(data.v.begin(), data.v.end());
+    if (request.command == Command::Resume) {
+        int lobbyId = 0;
+        bool resumed = false;
+        if (sessions.Resume(request.token, lobbyId)) {
+            ProfiledLock lock(lobbiesMutex, __func__);
+            auto it = lobbies.find(lobbyId);
+            resumed = it != lobbies.end() && it->second->ResumePlayer(request.token, client);
+        }
+        if (!resumed) {
+            client->SendStatus(Status::ResumeFailed);
+        }
+        return;
+    }
 
     Lobby* allocatedLobby = nullptr;
-    std::unique_lock<std::mutex> lock(lobbiesMutex);
+    ProfiledLock lock(lobbiesMutex, __func__);
 
-    if (choice == "create") {
-        auto newLobby = std::make_unique<Lobby>();
+    if (request.command == Command::Create) {
+        auto newLobby = std::make_shared<Lobby>();
         int newLobbyId = newLobby->GetLobbyId();
+        auto snapshot = std::make_shared<LobbyList>(*std::atomic_load(&lobbySnapshot));
+        snapshot->push_back(newLobby);
+        std::atomic_store(&lobbySnapshot, std::shared_ptr<const LobbyList>(std::move(snapshot)));
         lobbies[newLobbyId] = std::move(newLobby);
         allocatedLobby = lobbies[newLobbyId].get();
-        std::cout << "New Lobby created with ID " << newLobbyId << std::endl;
-    } else if (choice == "join") {
+        Log(LogLevel::Info) << "New Lobby created with ID " << newLobbyId;
+    } else if (request.command == Command::Join) {
+        // The published summary may be a moment stale; AddPlayer rechecks
+        // under the lobby's own lock, so no need to take each one here.
         auto it = std::find_if(lobbies.begin(), lobbies.end(), [](const auto& pair) {
-            return pair.second->PlayerCount() < 2;
+            return pair.second->Describe().players < LobbyEngine::MaxPlayers;
         });
         if (it != lobbies.end()) {
             allocatedLobby = it->second.get();
-            std::cout << "Joining existing lobby with ID " << it->first << std::endl;
+            Log(LogLevel::Info) << "Joining existing lobby with ID " << it->first;
         } else {
-            const std::string message = "No available lobby to join. Please try creating a new one.";
-            client.Write(message);
+            client->SendStatus(Status::NoLobbyAvailable);
             return;
-            // std::cout << "No available lobby to join. Please try creating a new one." << std::endl;
         }
     }
 
-    if (allocatedLobby && allocatedLobby->AddPlayer(std::move(client))) {
-        std::cout << "Player successfully added to lobbyID " << allocatedLobby->GetLobbyId() << std::endl;
-        if (allocatedLobby->PlayerCount() == 2) {
-            allocatedLobby->Start();
+    if (allocatedLobby) {
+        span.SetLobby(allocatedLobby->GetLobbyId());
+    }
+    if (allocatedLobby && allocatedLobby->AddPlayer(client)) {
+        Log(LogLevel::Info) << "Player successfully added to lobbyID " << allocatedLobby->GetLobbyId();
+    } else {
+        Log(LogLevel::Warning) << "Player could not be added to the lobby.";
+    }
+
+    lock.Unlock();
+}
+
+// Hands slots whose grace window ran out back to the normal leave path.
+// Also flushes the event trace so a crash loses at most a second of it.
+void ReapSessions() {
+    while (!terminateServer) {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        if (recorder) {
+            recorder->Flush();
         }
-        else {
-            const std::string message = "Waiting for one more player";
-            client.Write(message);
+        for (auto& expired : sessions.Expire()) {
+            // Dropping the last player retires the lobby, which needs lobbiesMutex
+            std::shared_ptr<Lobby> lobby;
+            {
+                ProfiledLock lock(lobbiesMutex, __func__);
+                auto it = lobbies.find(expired.lobbyId);
+                if (it != lobbies.end()) {
+                    lobby = it->second;
+                }
+            }
+            if (lobby) {
+                lobby->DropPlayer(expired.token);
+            }
         }
-    } else {
-        std::cerr << "Player could not be added to the lobby." << std::endl;
     }
+}
 
-    lock.unlock();
+void AcceptClients(SocketServer &server) {
+    // Local sockets are for co-located bots and sidecars, so they skip TLS
+    bool secure = tlsContext && !server.GetEndpoint().IsLocal();
+    try {
+        while (!terminateServer) {
+            Socket client = server.Accept();
+            // Refused peers are closed here, before they cost a thread or a TLS handshake
+            auto admission = limiter.Admit(client.GetEndpoint());
+            if (!admission) {
+                client.Close();
+                continue;
+            }
+            std::thread clientThread(HandleClient, std::move(client), secure, std::move(admission));
+            clientThread.detach();  // Detach client thread to let it run independently
+        }
+    } catch (TerminationException) {
+        // Shutdown() was called on this listener
+    } catch (const std::string &error) {
+        // Accept fails on a listener closed by Shutdown(); anything else is a real error
+        if (!terminateServer) {
+            Log(LogLevel::Error) << "Error on " << server.GetEndpoint().ToString() << ": " << error;
+        }
+    }
+}
+
+void StopServer(std::vector<std::unique_ptr<SocketServer>> &servers) {
+    if (terminateServer.exchange(true)) {
+        return;
+    }
+    Log(LogLevel::Info) << "Received request to stop server. Terminating...";
+    for (auto& server : servers) {
+        server->Shutdown();
+    }
+}
+
+std::shared_ptr<Lobby> FindLobby(int lobbyId) {
+    std::shared_ptr<const LobbyList> snapshot = std::atomic_load(&lobbySnapshot);
+    for (auto& lobby : *snapshot) {
+        if (lobby->GetLobbyId() == lobbyId) {
+            return lobby;
+        }
+    }
+    return nullptr;
+}
+
+// Runs one operator command and returns its reply. Every reply ends with a
+// line that is either "ok" or starts with "error:", so scripts know where it stops.
+// A stop is left to the caller so the reply can go out before the server winds down.
+std::string RunAdminCommand(const std::string &line, bool &stop) {
+    std::istringstream in(line);
+    std::ostringstream out;
+    std::string command;
+    in >> command;
+
+    if (command == "help") {
+        out << "lobbies                  list lobbies with their age, players and round\n"
+            << "kick <lobby> <player>    remove a player or bot from a lobby\n"
+            << "resolve <lobby>          end the current round now\n"
+            << "loglevel [level]         show or set error, warning, info or debug\n"
+            << "workers [n]              show or resize the worker pool\n"
+            << "stats [reset]            connections, queues, latency and lock waits\n"
+            << "trace start|stop <file>  record spans and write them as Chrome trace JSON\n"
+            << "stop                     stop the server\n";
+    } else if (command == "lobbies") {
+        for (auto& lobby : *std::atomic_load(&lobbySnapshot)) {
+            Lobby::Summary summary = lobby->Describe();
+            out << "lobby " << summary.lobbyId
+                << " age " << std::chrono::duration_cast<std::chrono::seconds>(summary.age).count() << "s"
+                << " players " << summary.players
+                << " bots " << summary.bots
+                << " disconnected " << summary.disconnected
+                << " round " << summary.round << "\n";
+        }
+    } else if (command == "kick" || command == "resolve") {
+        int lobbyId = 0;
+        int playerId = 0;
+        if (!(in >> lobbyId) || (command == "kick" && !(in >> playerId))) {
+            return "error: usage " + command + (command == "kick" ? " <lobby> <player>\n" : " <lobby>\n");
+        }
+        std::shared_ptr<Lobby> lobby = FindLobby(lobbyId);
+        if (!lobby) {
+            return "error: no lobby " + std::to_string(lobbyId) + "\n";
+        }
+        if (command == "kick" && !lobby->Kick(playerId)) {
+            return "error: no player " + std::to_string(playerId) + " in lobby " + std::to_string(lobbyId) + "\n";
+        }
+        if (command == "resolve" && !lobby->ForceResolve()) {
+            return "error: lobby " + std::to_string(lobbyId) + " has no round in progress\n";
+        }
+    } else if (command == "loglevel") {
+        std::string name;
+        if (in >> name) {
+            LogLevel level;
+            if (!ParseLogLevel(name, level)) {
+                return "error: unknown log level " + name + "\n";
+            }
+            SetLogLevel(level);
+        }
+        out << "loglevel " << LogLevelName(GetLogLevel()) << "\n";
+    } else if (command == "workers") {
+        int count = 0;
+        if (in >> count) {
+            if (count <= 0) {
+                return "error: need at least one worker\n";
+            }
+            scheduler->Resize(count);
+        }
+        out << "workers " << scheduler->WorkerCount() << " pending " << scheduler->Pending() << "\n";
+    } else if (command == "stats") {
+        std::string option;
+        if (in >> option) {
+            if (option != "reset") {
+                return "error: usage stats [reset]\n";
+            }
+            requestLatency.Reset();
+            for (LockStats *stats : AllLockStats()) {
+                stats->Reset();
+            }
+        }
+        out << "connections " << limiter.Connections() << " rejected " << limiter.Rejected() << "\n"
+            << "lobbies " << std::atomic_load(&lobbySnapshot)->size() << "\n"
+            << "workers " << scheduler->WorkerCount() << " pending " << scheduler->Pending() << "\n"
+            << "request latency " << FormatSummary(requestLatency.Summarize()) << "\n"
+            << "tracing " << (IsTracing() ? "on" : "off") << "\n";
+        for (LockStats *stats : AllLockStats()) {
+            out << stats->Report();
+        }
+    } else if (command == "trace") {
+        std::string action;
+        std::string path;
+        in >> action;
+        if (action == "start") {
+            StartTracing();
+        } else if (action == "stop" && in >> path) {
+            StopTracing();
+            try {
+                size_t count = ExportChromeTrace(path);
+                out << "trace " << count << " spans written to " << path << ", " << DroppedSpans() << " dropped\n";
+            } catch (const std::string &error) {
+                return "error: " + error + "\n";
+            }
+        } else {
+            return "error: usage trace start|stop <file>\n";
+        }
+    } else if (command == "stop") {  // Also takes the old "stop server"
+        stop = true;
+    } else {
+        return "error: unknown command " + command + ", try help\n";
+    }
+    out << "ok\n";
+    return out.str();
 }
 
-void ReadServerInput(SocketServer &server) {
+// The terminal takes the same commands as the admin socket.
+void ReadServerInput(std::vector<std::unique_ptr<SocketServer>> &servers) {
     std::string input;
-    while (true) {
-        std::getline(std::cin, input);
-        if (input == "stop server") {
-            std::cout << "Received request to stop server. Terminating..." << std::endl;
-            server.Shutdown();
-            terminateServer = true;
-            break;
+    bool stop = false;
+    while (!stop && !terminateServer && std::getline(std::cin, input)) {
+        if (!input.empty()) {
+            std::cout << RunAdminCommand(input, stop) << std::flush;
         }
     }
+    if (stop) {
+        StopServer(servers);
+    }
 }
 
-int main() {
+void HandleAdmin(Socket socket, std::vector<std::unique_ptr<SocketServer>> &servers) {
+    std::string pending;
+    ByteArray data;
+    while (socket.Read(data) > 0) {
+        pending.append(data.v.begin(), data.v.end());
+        size_t end;
+        while ((end = pending.find('\n')) != std::string::npos) {
+            std::string line = pending.substr(0, end);
+            pending.erase(0, end + 1);
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            bool stop = false;
+            if (!line.empty() && socket.Write(ByteArray(RunAdminCommand(line, stop))) <= 0) {
+                return;
+            }
+            if (stop) {
+                StopServer(servers);
+                return;
+            }
+        }
+    }
+}
+
+void AcceptAdmins(SocketServer &adminServer, std::vector<std::unique_ptr<SocketServer>> &servers) {
     try {
-        SocketServer server(3000);
-        std::cout << "Server started. Waiting for players..." << std::endl;
+        while (!terminateServer) {
+            Socket admin = adminServer.Accept();
+            std::thread(HandleAdmin, std::move(admin), std::ref(servers)).detach();
+        }
+    } catch (TerminationException) {
+        // Shutdown() was called on the admin listener
+    } catch (const std::string &error) {
+        if (!terminateServer) {
+            Log(LogLevel::Error) << "Error on admin socket: " << error;
+        }
+    }
+}
 
-        std::thread inputThread(ReadServerInput, std::ref(server));  // Start a thread to read server terminal input
+int main(int argc, char *argv[]) {
+    try {
+        std::vector<Endpoint> endpoints;
+        std::unique_ptr<Endpoint> adminEndpoint;
+        for (int i = 1; i < argc; i++) {
+            std::string option = argv[i];
+            if (option == "--tls" && i + 2 < argc) {
+                tlsContext = std::make_unique<TlsContext>(argv[i + 1], argv[i + 2]);
+                Log(LogLevel::Info) << "TLS enabled with certificate " << argv[i + 1];
+                i += 2;
+            } else if (option == "--record" && i + 1 < argc) {
+                recorder = std::make_unique<TraceRecorder>(argv[++i]);
+                Log(LogLevel::Info) << "Recording lobby events to " << argv[i];
+            } else if (option == "--bots-after" && i + 1 < argc) {
+                botDelay = std::chrono::seconds(std::stoi(argv[++i]));
+            } else if (option == "--workers" && i + 1 < argc) {
+                scheduler = std::make_unique<Scheduler>(std::stoi(argv[++i]));
+            } else if (option == "--max-connections" && i + 1 < argc) {
+                limiter.SetMaxTotal(std::stoi(argv[++i]));
+            } else if (option == "--max-per-address" && i + 1 < argc) {
+                limiter.SetMaxPerSource(std::stoi(argv[++i]));
+            } else if (option == "--listen" && i + 1 < argc) {
+                endpoints.push_back(Endpoint::Parse(argv[++i]));
+            } else if (option == "--admin" && i + 1 < argc) {
+                adminEndpoint = std::make_unique<Endpoint>(Endpoint::Parse(argv[++i]));
+                if (!adminEndpoint->IsLocal()) {
+                    throw std::string("The admin socket must be a unix socket");
+                }
+            } else if (option == "--log-level" && i + 1 < argc) {
+                LogLevel level;
+                if (!ParseLogLevel(argv[++i], level)) {
+                    throw std::string("Unknown log level ") + argv[i];
+                }
+                SetLogLevel(level);
+            } else {
+                std::cerr << "Usage: " << argv[0] << " [--tls <certificate.pem> <key.pem>] [--record <trace>]"
+                          << " [--bots-after <seconds>] [--workers <n>]"
+                          << " [--max-connections <n>] [--max-per-address <n>]"
+                          << " [--admin <unix:path>] [--log-level <error|warning|info|debug>]"
+                          << " [--listen <port|host:port|[ipv6]:port|unix:path|seqpacket:path>]..." << std::endl;
+                return 1;
+            }
+        }
+        if (endpoints.empty()) {
+            endpoints.push_back(Endpoint::Inet("0.0.0.0", 3000));
+        }
+        if (!scheduler) {
+            scheduler = std::make_unique<Scheduler>(std::max(2u, std::thread::hardware_concurrency()));
+        }
 
-        while (!terminateServer) {
-            Socket client = server.Accept();
-            std::thread clientThread(HandleClient, std::move(client));
-            clientThread.detach();  // Detach client thread to let it run independently
+        std::vector<std::unique_ptr<SocketServer>> servers;
+        for (auto& endpoint : endpoints) {
+            servers.push_back(std::make_unique<SocketServer>(endpoint));
+            Log(LogLevel::Info) << "Listening on " << endpoint.ToString();
+        }
+        std::unique_ptr<SocketServer> adminServer;
+        std::thread adminThread;
+        if (adminEndpoint) {
+            adminServer = std::make_unique<SocketServer>(*adminEndpoint);
+            adminThread = std::thread(AcceptAdmins, std::ref(*adminServer), std::ref(servers));
+            Log(LogLevel::Info) << "Admin socket on " << adminEndpoint->ToString();
         }
+        Log(LogLevel::Info) << "Server started. Waiting for players...";
 
-        inputThread.join();  // Wait for the input thread to finish
+        // Not joined: it may sit in getline after the admin socket stopped the server
+        std::thread(ReadServerInput, std::ref(servers)).detach();
+        std::thread(ReapSessions).detach();
+
+        std::vector<std::thread> acceptThreads;
+        for (auto& server : servers) {
+            acceptThreads.emplace_back(AcceptClients, std::ref(*server));
+        }
+        for (auto& acceptThread : acceptThreads) {
+            acceptThread.join();
+        }
+
+        if (adminServer) {
+            adminServer->Shutdown();
+            adminThread.join();
+        }
+        scheduler->Shutdown();
+        if (recorder) {
+            recorder->Flush();
+        }
         
     } catch (const std::string& error) {
-        std::cerr << "Error: " << error << std::endl;
+        Log(LogLevel::Error) << "Error: " << error;
         return 1;
     }
     
-    std::cout << "Server terminated gracefully." << std::endl;
+    Log(LogLevel::Info) << "Server terminated gracefully.";
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,147 @@
+#include "socket.h"
+#include "socketserver.h"
+#include <unistd.h>
+#include <iostream>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace Sync;
+
+// Load benchmark for the networking core: clients send fixed size messages
+// through Socket/SocketServer to echo threads and wait for each reply, so
+// every round trip goes through Write, FlexWait and Read on both sides. It is
+// also the training run for "make pgo".
+//
+//     SyncBench [--clients <n>] [--messages <n>] [--size <bytes>] [--listen <endpoint>]...
+//
+// With no --listen it runs once over a Unix socket and once over TCP loopback.
+
+struct Options {
+    int clients = 8;
+    int messages = 20000;
+    int size = 64;
+};
+
+static void Echo(Socket socket) {
+    ByteArray data;
+    while (socket.Read(data) > 0) {
+        if (socket.Write(data) <= 0) {
+            break;
+        }
+    }
+}
+
+// Returns the summed round trip time of one client's messages.
+static std::chrono::steady_clock::duration RunClient(const Endpoint &endpoint, const Options &options) {
+    Socket socket(endpoint);
+    socket.Open();
+    ByteArray message(std::string(options.size, 'x'));
+    std::chrono::steady_clock::duration total(0);
+    for (int i = 0; i < options.messages; i++) {
+        auto sent = std::chrono::steady_clock::now();
+        if (socket.Write(message) <= 0) {
+            throw std::string("Echo server went away");
+        }
+        // A stream may hand the reply back in pieces
+        size_t received = 0;
+        ByteArray reply;
+        while (received < message.v.size()) {
+            if (socket.Read(reply) <= 0) {
+                throw std::string("Echo server went away");
+            }
+            received += reply.v.size();
+        }
+        total += std::chrono::steady_clock::now() - sent;
+    }
+    return total;
+}
+
+static void Run(const Endpoint &endpoint, const Options &options) {
+    SocketServer server(endpoint);
+    std::vector<std::thread> echoes;
+    std::thread acceptor([&]() {
+        for (int i = 0; i < options.clients; i++) {
+            echoes.emplace_back(Echo, server.Accept());
+        }
+    });
+
+    std::vector<std::chrono::steady_clock::duration> roundTrips(options.clients);
+    std::vector<std::string> errors(options.clients);
+    auto started = std::chrono::steady_clock::now();
+    std::vector<std::thread> clients;
+    for (int i = 0; i < options.clients; i++) {
+        clients.emplace_back([&, i]() {
+            try {
+                roundTrips[i] = RunClient(endpoint, options);
+            } catch (const std::string &error) {
+                errors[i] = error;
+            }
+        });
+    }
+    for (auto &client : clients) {
+        client.join();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - started;
+
+    // Clients hang up first, which ends the echo threads
+    acceptor.join();
+    for (auto &echo : echoes) {
+        echo.join();
+    }
+    server.Shutdown();
+
+    std::chrono::steady_clock::duration total(0);
+    for (int i = 0; i < options.clients; i++) {
+        if (!errors[i].empty()) {
+            throw errors[i];
+        }
+        total += roundTrips[i];
+    }
+    double count = (double)options.clients * options.messages;
+    std::cout << endpoint.ToString() << ": " << options.clients << " clients x " << options.messages
+              << " round trips of " << options.size << " bytes in " << elapsed.count() << "s ("
+              << (long)(count / elapsed.count()) << " round trips/s, mean "
+              << std::chrono::duration_cast<std::chrono::microseconds>(total).count() / (long)count << "us)"
+              << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    try {
+        Options options;
+        std::vector<Endpoint> endpoints;
+        for (int i = 1; i < argc; i++) {
+            std::string option = argv[i];
+            if (option == "--clients" && i + 1 < argc) {
+                options.clients = std::stoi(argv[++i]);
+            } else if (option == "--messages" && i + 1 < argc) {
+                options.messages = std::stoi(argv[++i]);
+            } else if (option == "--size" && i + 1 < argc) {
+                options.size = std::stoi(argv[++i]);
+            } else if (option == "--listen" && i + 1 < argc) {
+                endpoints.push_back(Endpoint::Parse(argv[++i]));
+            } else {
+                std::cerr << "Usage: " << argv[0] << " [--clients <n>] [--messages <n>] [--size <bytes>]"
+                          << " [--listen <endpoint>]..." << std::endl;
+                return 1;
+            }
+        }
+        // Reads are at most 256 bytes, so larger messages would only measure reassembly
+        if (options.clients <= 0 || options.messages <= 0 || options.size <= 0 || options.size > 256) {
+            throw std::string("Clients and messages must be positive and size between 1 and 256");
+        }
+        if (endpoints.empty()) {
+            // Per process names so concurrent runs don't collide
+            endpoints.push_back(Endpoint::Unix("@syncbench-" + std::to_string(getpid())));
+            endpoints.push_back(Endpoint::Inet("127.0.0.1", 20000 + getpid() % 20000));
+        }
+        for (auto &endpoint : endpoints) {
+            Run(endpoint, options);
+        }
+    } catch (const std::string &error) {
+        std::cerr << "Error: " << error << std::endl;
+        return 1;
+    }
+    return 0;
+}
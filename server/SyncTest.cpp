@@ -0,0 +1,419 @@
+#include "socket.h"
+#include "socketserver.h"
+#include "ratelimit.h"
+#include "protocol.h"
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <chrono>
+#include <future>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace Sync;
+using namespace Protocol;
+
+// Unit checks for the networking core: ownership of descriptors across moves
+// and closes, endpoint parsing, FlexWait, waking blocked threads and per source
+// limits, plus the binary protocol's handling of malformed input. "make test"
+// runs these and then a short SyncBench.
+
+static int checks = 0;
+static int failures = 0;
+
+#define CHECK(condition) Check((condition), #condition, __FILE__, __LINE__)
+
+static void Check(bool passed, const char *text, const char *file, int line) {
+    checks++;
+    if (!passed) {
+        failures++;
+        std::cerr << file << ":" << line << ": check failed: " << text << std::endl;
+    }
+}
+
+static bool IsOpen(int fd) {
+    return fcntl(fd, F_GETFD) != -1;
+}
+
+// A connected pair; the test takes ownership of whichever ends it wraps.
+static std::vector<int> Pair() {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        throw std::string("Unable to create a socket pair");
+    }
+    return {fds[0], fds[1]};
+}
+
+static void TestMovedFromSocket() {
+    std::vector<int> fds = Pair();
+    Socket peer(fds[1]);
+    Socket first(fds[0]);
+    Socket second(std::move(first));
+    CHECK(first.GetFD() == -1);
+    CHECK(second.GetFD() == fds[0]);
+    {
+        // Destroying the empty shell must leave the moved descriptor alone
+        Socket shell(std::move(first));
+        CHECK(shell.GetFD() == -1);
+    }
+    CHECK(IsOpen(fds[0]));
+
+    std::vector<int> other = Pair();
+    Socket otherPeer(other[1]);
+    Socket third(other[0]);
+    int replaced = third.GetFD();
+    third = std::move(second);
+    CHECK(third.GetFD() == fds[0]);
+    CHECK(second.GetFD() == -1);
+    CHECK(!IsOpen(replaced));
+
+    CHECK(third.Write(ByteArray(std::string("ping"))) == 4);
+    ByteArray reply;
+    CHECK(peer.Read(reply) == 4);
+    CHECK(reply.ToString() == "ping");
+}
+
+static void TestCloseTwice() {
+    std::vector<int> fds = Pair();
+    Socket peer(fds[1]);
+    Socket socket(fds[0]);
+    socket.Close();
+    CHECK(socket.GetFD() == -1);
+    CHECK(!IsOpen(fds[0]));
+
+    // Hand the number to someone else; a second close must not take it away
+    int reused = dup2(fds[1], fds[0]);
+    CHECK(reused == fds[0]);
+    socket.Close();
+    CHECK(IsOpen(reused));
+    close(reused);
+}
+
+static void TestReadAfterClose() {
+    std::vector<int> fds = Pair();
+    Socket peer(fds[1]);
+    Socket socket(fds[0]);
+    peer.Write(ByteArray(std::string("unread")));
+    socket.Close();
+    ByteArray data;
+    CHECK(socket.Read(data) == 0);
+    CHECK(data.v.empty());
+    CHECK(socket.Write(ByteArray(std::string("late"))) <= 0);
+}
+
+static void TestEventMove() {
+    Event event;
+    int fd = event.GetFD();
+    Event moved(std::move(event));
+    CHECK(moved.GetFD() == fd);
+    CHECK(event.GetFD() == -1);
+
+    Event assigned;
+    int replaced = assigned.GetFD();
+    assigned = std::move(moved);
+    CHECK(assigned.GetFD() == fd);
+    CHECK(moved.GetFD() == -1);
+    CHECK(!IsOpen(replaced));
+
+    // The write end travelled with the read end
+    FlexWait waiter(1, &assigned);
+    CHECK(waiter.Wait(FlexWait::POLL) == nullptr);
+    assigned.Trigger();
+    CHECK(waiter.Wait(FlexWait::POLL) == &assigned);
+    assigned.Reset();
+    CHECK(waiter.Wait(FlexWait::POLL) == nullptr);
+}
+
+static void TestEndpointRoundTrip() {
+    const char *texts[] = {"127.0.0.1:3000", "0.0.0.0:80", "[::1]:3001", "[fe80::1]:65535",
+                           "unix:/tmp/rps.sock", "seqpacket:/tmp/rps.sock", "unix:@rps-spec",
+                           "seqpacket:@rps"};
+    for (const char *text : texts) {
+        Endpoint endpoint = Endpoint::Parse(text);
+        CHECK(endpoint.ToString() == text);
+        CHECK(Endpoint::Parse(endpoint.ToString()).ToString() == text);
+    }
+    CHECK(Endpoint::Parse("3000").ToString() == "0.0.0.0:3000");
+    CHECK(Endpoint::Parse("seqpacket:/tmp/rps.sock").type == SOCK_SEQPACKET);
+    CHECK(Endpoint::Parse("unix:@rps").Path().empty());
+    CHECK(Endpoint::Parse("unix:/tmp/rps.sock").Path() == "/tmp/rps.sock");
+    CHECK(Endpoint::Parse("[::1]:3001").Family() == AF_INET6);
+
+    // An accepted peer that never bound has only the address family
+    Endpoint unnamed;
+    unnamed.address.ss_family = AF_UNIX;
+    unnamed.length = sizeof(sa_family_t);
+    CHECK(unnamed.ToString() == "unix:");
+    CHECK(unnamed.Path().empty());
+    SocketServer server(Endpoint::Unix("@synctest-peer-" + std::to_string(getpid())));
+    Socket connecting(server.GetEndpoint());
+    connecting.Open();
+    Socket accepted = server.Accept();
+    CHECK(accepted.GetEndpoint().ToString() == "unix:");
+
+    const char *invalid[] = {"", "localhost:3000", "1.2.3.4:port", "unix:"};
+    for (const char *text : invalid) {
+        bool threw = false;
+        try {
+            Endpoint::Parse(text);
+        } catch (const std::string &) {
+            threw = true;
+        }
+        CHECK(threw);
+    }
+}
+
+static void TestHighDescriptors() {
+    rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    if (limit.rlim_cur < FD_SETSIZE + 64 && limit.rlim_max >= FD_SETSIZE + 64) {
+        limit.rlim_cur = FD_SETSIZE + 64;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+    std::vector<int> fds = Pair();
+    int high = fcntl(fds[0], F_DUPFD, FD_SETSIZE + 8);
+    close(fds[0]);
+    if (high < 0) {
+        std::cerr << "skipping descriptors above FD_SETSIZE: limit too low" << std::endl;
+        close(fds[1]);
+        return;
+    }
+    Socket peer(fds[1]);
+    Socket socket(high);
+    Event idle;
+    FlexWait waiter(2, &idle, &socket);
+    CHECK(waiter.Wait(FlexWait::POLL) == nullptr);
+    peer.Write(ByteArray(std::string("wake")));
+    CHECK(waiter.Wait(1000) == &socket);
+    ByteArray data;
+    CHECK(socket.Read(data) == 4);
+}
+
+static void TestShutdownWakesAccept() {
+    SocketServer server(Endpoint::Unix("@synctest-" + std::to_string(getpid())));
+    std::promise<bool> woke;
+    std::future<bool> result = woke.get_future();
+    std::thread acceptor([&]() {
+        try {
+            server.Accept();
+            woke.set_value(false);
+        } catch (TerminationException) {
+            woke.set_value(true);
+        } catch (const std::string &) {
+            woke.set_value(false);
+        }
+    });
+    // Give the acceptor time to block before pulling the rug
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    server.Shutdown();
+    if (result.wait_for(std::chrono::seconds(2)) != std::future_status::ready) {
+        std::cerr << "Accept did not return after Shutdown" << std::endl;
+        _exit(1);
+    }
+    CHECK(result.get());
+    acceptor.join();
+    // The acceptor might still have been using the descriptor, so it stays
+    // open until the server is destroyed
+    CHECK(IsOpen(server.GetFD()));
+    server.Shutdown();  // Again, as the destructor will
+    bool threw = false;
+    try {
+        server.Accept();
+    } catch (TerminationException) {
+        threw = true;
+    }
+    CHECK(threw);
+}
+
+static void TestInterruptWakesRead() {
+    std::vector<int> fds = Pair();
+    Socket peer(fds[1]);
+    Socket socket(fds[0]);
+    std::promise<int> woke;
+    std::future<int> result = woke.get_future();
+    std::thread reader([&]() {
+        ByteArray data;
+        woke.set_value(socket.Read(data));
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    socket.Interrupt();
+    if (result.wait_for(std::chrono::seconds(2)) != std::future_status::ready) {
+        std::cerr << "Read did not return after Interrupt" << std::endl;
+        _exit(1);
+    }
+    CHECK(result.get() == 0);
+    reader.join();
+    // Closing is left to the owner, so the number can't be reused under a reader
+    CHECK(socket.GetFD() == fds[0]);
+    CHECK(IsOpen(fds[0]));
+    CHECK(socket.Write(ByteArray(std::string("late"))) <= 0);
+    socket.Close();
+    CHECK(!IsOpen(fds[0]));
+}
+
+static void TestMappedSources() {
+    // Two connections per source, no refill
+    SourceLimiter limiter({{100, 0}, {100, 0}, 2, 100});
+    std::vector<std::shared_ptr<Admission>> held;
+    held.push_back(limiter.Admit(Endpoint::Inet("::ffff:127.0.0.1", 1)));
+    held.push_back(limiter.Admit(Endpoint::Inet("127.0.0.1", 2)));
+    CHECK(held[0] && held[1]);
+    // Mapped and plain IPv4 are the same source
+    CHECK(!limiter.Admit(Endpoint::Inet("::ffff:127.0.0.1", 3)));
+    CHECK(!limiter.Admit(Endpoint::Inet("127.0.0.1", 4)));
+    // ...but other IPv4 hosts behind the same listener are not
+    CHECK(limiter.Admit(Endpoint::Inet("::ffff:10.9.8.7", 5)) != nullptr);
+    CHECK(limiter.Admit(Endpoint::Inet("10.9.8.6", 6)) != nullptr);
+}
+
+// A pair that keeps each write a separate read, to split messages at will.
+static std::vector<int> PacketPair() {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds) != 0) {
+        throw std::string("Unable to create a socket pair");
+    }
+    return {fds[0], fds[1]};
+}
+
+static ByteArray Bytes(std::vector<int> const &values) {
+    ByteArray bytes;
+    for (int value : values) {
+        bytes.v.push_back((char)value);
+    }
+    return bytes;
+}
+
+static void TestHello() {
+    {
+        // Magic and version in separate reads, the first frame right behind
+        std::vector<int> fds = PacketPair();
+        Socket peer(fds[1]);
+        Connection connection{Socket(fds[0])};
+        peer.Write(Bytes({HelloMagic}));
+        peer.Write(Bytes({Version, OpCreate, 0}));
+        CHECK(connection.Negotiate());
+        CHECK(connection.GetWire() == Wire::Binary);
+        ByteArray ack;
+        CHECK(peer.Read(ack) > 0);
+        CHECK(ack.v == EncodeHelloAck(Version).v);
+        Request request;
+        CHECK(connection.ReadRequest(request));
+        CHECK(request.command == Command::Create);
+    }
+    {
+        // Newer clients are answered with the version the server speaks
+        std::vector<int> fds = PacketPair();
+        Socket peer(fds[1]);
+        Connection connection{Socket(fds[0])};
+        peer.Write(Bytes({HelloMagic, 200}));
+        CHECK(connection.Negotiate());
+        ByteArray ack;
+        CHECK(peer.Read(ack) > 0);
+        CHECK(ack.v == EncodeHelloAck(Version).v);
+    }
+    {
+        // Version 0 does not exist
+        std::vector<int> fds = PacketPair();
+        Socket peer(fds[1]);
+        Connection connection{Socket(fds[0])};
+        peer.Write(Bytes({HelloMagic, 0}));
+        CHECK(!connection.Negotiate());
+    }
+    {
+        // A hello cut short by a hang-up
+        std::vector<int> fds = PacketPair();
+        Socket peer(fds[1]);
+        Connection connection{Socket(fds[0])};
+        peer.Write(Bytes({HelloMagic}));
+        peer.Close();
+        CHECK(!connection.Negotiate());
+    }
+}
+
+static void TestMalformedFrames() {
+    uint8_t opcode = 0;
+    std::string payload;
+    {
+        // Length one past the limit
+        FrameReader frames;
+        std::vector<char> frame(1, (char)OpChoice);
+        PutVarint(frame, FrameReader::MaxPayloadSize + 1);
+        frame.resize(frame.size() + FrameReader::MaxPayloadSize + 1, 'x');
+        frames.Feed(frame.data(), frame.size());
+        CHECK(!frames.Next(opcode, payload));
+        CHECK(frames.IsCorrupt());
+    }
+    {
+        // A varint that never ends
+        FrameReader frames;
+        std::vector<char> frame(1, (char)OpChoice);
+        frame.resize(12, (char)0x80);
+        frames.Feed(frame.data(), frame.size());
+        CHECK(!frames.Next(opcode, payload));
+        CHECK(frames.IsCorrupt());
+    }
+    {
+        // A truncated varint waits for the rest, byte by byte
+        FrameReader frames;
+        ByteArray frame = Bytes({OpChoice, 0x81, 0x00, (int)Move::Paper});
+        for (size_t i = 0; i < frame.v.size(); i++) {
+            CHECK(!frames.Next(opcode, payload));
+            frames.Feed(&frame.v[i], 1);
+        }
+        CHECK(!frames.IsCorrupt());
+        CHECK(frames.Next(opcode, payload));
+        CHECK(opcode == OpChoice && payload.size() == 1);
+        CHECK(!frames.Next(opcode, payload));
+    }
+    {
+        // Two frames in one feed come out in order
+        FrameReader frames;
+        ByteArray both = Bytes({OpCreate, 0, OpSpectate, 1, 7});
+        frames.Feed(both.v.data(), both.v.size());
+        CHECK(frames.Next(opcode, payload) && opcode == OpCreate && payload.empty());
+        CHECK(frames.Next(opcode, payload) && opcode == OpSpectate);
+        CHECK(ParseFrame(opcode, payload).lobbyId == 7);
+    }
+
+    // Payloads that don't fit their opcode
+    CHECK(ParseFrame(OpChoice, std::string(1, (char)0)).command == Command::Unknown);
+    CHECK(ParseFrame(OpChoice, std::string(1, (char)9)).command == Command::Unknown);
+    CHECK(ParseFrame(OpChoice, "").command == Command::Unknown);
+    CHECK(ParseFrame(OpResume, std::string(8, 'x')).command == Command::Unknown);
+    CHECK(ParseFrame(OpSpectate, std::string(1, (char)0x80)).lobbyId == -1);
+    CHECK(ParseFrame(OpSpectate, "").lobbyId == -1);
+    CHECK(ParseFrame(0x7F, "").command == Command::Unknown);
+
+    std::vector<char> huge;
+    PutVarint(huge, (uint64_t)INT32_MAX + 1);
+    CHECK(ParseFrame(OpSpectate, std::string(huge.begin(), huge.end())).lobbyId == -1);
+
+    SessionToken token(3, 0x0123456789abcdefull);
+    ByteArray session = EncodeSession(Wire::Binary, token);
+    Request request = ParseFrame(OpResume, std::string(session.v.begin() + 2, session.v.end()));
+    CHECK(request.command == Command::Resume);
+    CHECK(request.token.index == 3 && request.token.tag == 0x0123456789abcdefull);
+}
+
+int main() {
+    try {
+        TestMovedFromSocket();
+        TestCloseTwice();
+        TestReadAfterClose();
+        TestEventMove();
+        TestEndpointRoundTrip();
+        TestHighDescriptors();
+        TestShutdownWakesAccept();
+        TestInterruptWakesRead();
+        TestMappedSources();
+        TestHello();
+        TestMalformedFrames();
+    } catch (const std::string &error) {
+        std::cerr << "Error: " << error << std::endl;
+        return 1;
+    }
+    std::cout << checks << " checks, " << failures << " failed" << std::endl;
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,99 @@
+#include "bot.h"
+
+using namespace Protocol;
+
+static int MoveIndex(Move move)
+{
+    return (int)move - (int)Move::Rock;
+}
+
+static Move IndexMove(int index)
+{
+    return (Move)(index + (int)Move::Rock);
+}
+
+static int ArgMax(uint32_t const counts[3])
+{
+    int best = 0;
+    for (int i=1;i<3;i++)
+    {
+        if (counts[i] > counts[best])
+            best = i;
+    }
+    return best;
+}
+
+MovePredictor::MovePredictor(void)
+    : last(-1)
+{
+    for (int i=0;i<3;i++)
+    {
+        frequency[i] = 0;
+        for (int j=0;j<3;j++)
+            transitions[i][j] = 0;
+    }
+}
+
+void MovePredictor::Observe(Move opponentMove)
+{
+    if (opponentMove < Move::Rock || opponentMove > Move::Scissors)
+        return;
+    int index = MoveIndex(opponentMove);
+    frequency[index]++;
+    if (last >= 0)
+        transitions[last][index]++;
+    last = index;
+}
+
+Move MovePredictor::Predict(void) const
+{
+    if (last < 0)
+        return Move::None;
+    uint32_t const * row = transitions[last];
+    if (row[0] + row[1] + row[2] >= MarkovThreshold)
+        return IndexMove(ArgMax(row));
+    return IndexMove(ArgMax(frequency));
+}
+
+Move Beats(Move move)
+{
+    switch (move)
+    {
+    case Move::Rock: return Move::Paper;
+    case Move::Paper: return Move::Scissors;
+    case Move::Scissors: return Move::Rock;
+    default: return Move::None;
+    }
+}
+
+Bot::Bot(int id, uint64_t seed)
+    : playerId(id), state(seed ? seed : 0x9E3779B97F4A7C15ull)
+{
+    ;
+}
+
+uint64_t Bot::Random(void)
+{
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+void Bot::Observe(ResultRecord const & record)
+{
+    predictor.Observe(playerId == 1 ? record.move2 : record.move1);
+}
+
+Move Bot::NextMove(void)
+{
+    Move predicted = predictor.Predict();
+    if (predicted == Move::None || (int)(Random() % 100) < RandomPercent)
+        return IndexMove(Random() % 3);
+    return Beats(predicted);
+}
+
+int Bot::ThinkTime(void)
+{
+    return 300 + Random() % 700;
+}
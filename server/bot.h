@@ -0,0 +1,55 @@
+#ifndef BOT_H
+#define BOT_H
+#include <stdint.h>
+
+#include "protocol.h"
+
+// Guesses an opponent's next move from the moves they have made so far.
+//
+// It keeps how often each move was played and a first order Markov table of
+// which move followed which. Once the row for the opponent's last move has
+// enough samples the Markov guess is used, before that the overall favourite.
+// Everything is a handful of small counters, so observing and predicting are
+// constant time with no allocation.
+class MovePredictor
+{
+private:
+    uint32_t frequency[3];
+    uint32_t transitions[3][3];  // [previous][next]
+    int last;                    // Index of the opponent's last move, -1 before any
+
+public:
+    static const uint32_t MarkovThreshold = 3;
+    MovePredictor(void);
+    void Observe(Protocol::Move opponentMove);
+    // Move::None until there is anything to go on.
+    Protocol::Move Predict(void) const;
+};
+
+Protocol::Move Beats(Protocol::Move move);
+
+// A server side player. The lobby tells it about each finished round and asks
+// it for a move; it never touches a socket or owns a thread.
+class Bot
+{
+private:
+    int playerId;
+    MovePredictor predictor;
+    uint64_t state;  // xorshift64 state for the occasional random move
+
+    uint64_t Random(void);
+
+public:
+    // Percentage of moves played at random so the bot can't be farmed by a
+    // human who works out the predictor.
+    static const int RandomPercent = 15;
+
+    Bot(int playerId, uint64_t seed);
+    int GetPlayerId(void) const {return playerId;}
+    void Observe(Protocol::ResultRecord const & record);
+    Protocol::Move NextMove(void);
+    // Milliseconds to "think" before moving, so bot games run at human pace.
+    int ThinkTime(void);
+};
+
+#endif // BOT_H
@@ -0,0 +1,102 @@
+#include "broadcast.h"
+namespace Sync{
+
+SharedBuffer MakeSharedBuffer(std::string const & message)
+{
+    return std::make_shared<const ByteArray>(message);
+}
+
+SpectatorHub::SpectatorHub(size_t capacity)
+    : ring(capacity ? capacity : 1), visible(1), subscribers(0), closed(false)
+{
+    for (auto& entry : ring)
+        entry.sequence = 0;
+}
+
+void SpectatorHub::Publish(uint64_t sequence, SharedBuffer const & buffer)
+{
+    {
+        std::lock_guard<std::mutex> lock(ringMutex);
+        // Stale, or so far ahead it would overwrite what nobody has seen yet
+        if (closed || sequence < visible || sequence >= visible + ring.size())
+            return;
+        ring[sequence % ring.size()] = Entry{sequence, buffer};
+        uint64_t before = visible;
+        while (ring[visible % ring.size()].sequence == visible)
+            visible++;
+        if (visible == before)
+            return;  // Waiting for an earlier result to land
+    }
+    published.notify_all();
+}
+
+void SpectatorHub::Close(void)
+{
+    {
+        std::lock_guard<std::mutex> lock(ringMutex);
+        closed = true;
+    }
+    published.notify_all();
+}
+
+size_t SpectatorHub::Count(void)
+{
+    std::lock_guard<std::mutex> lock(ringMutex);
+    return subscribers;
+}
+
+SpectatorHub::Cursor::Cursor(std::shared_ptr<SpectatorHub> const & h)
+    : hub(h), dropped(0)
+{
+    std::lock_guard<std::mutex> lock(hub->ringMutex);
+    position = hub->visible;
+    hub->subscribers++;
+}
+
+SpectatorHub::Cursor::~Cursor(void)
+{
+    std::lock_guard<std::mutex> lock(hub->ringMutex);
+    hub->subscribers--;
+}
+
+bool SpectatorHub::Cursor::Wait(std::vector<SharedBuffer> & buffers, std::chrono::milliseconds timeout)
+{
+    std::unique_lock<std::mutex> lock(hub->ringMutex);
+    hub->published.wait_for(lock, timeout, [this]() {
+        return hub->closed || position < hub->visible;
+    });
+    uint64_t oldest = hub->visible > hub->ring.size() ? hub->visible - hub->ring.size() : 1;
+    if (position < oldest)
+    {
+        dropped += oldest - position;
+        position = oldest;
+    }
+    bool any = position < hub->visible;
+    for (; position < hub->visible; position++)
+        buffers.push_back(hub->ring[position % hub->ring.size()].buffer);
+    return any || !hub->closed;
+}
+
+void PumpSpectator(Socket & socket, SpectatorHub::Cursor & cursor)
+{
+    std::vector<SharedBuffer> buffers;
+    while (cursor.Wait(buffers, std::chrono::seconds(1)))
+    {
+        for (auto& buffer : buffers)
+        {
+            if (socket.Write(*buffer) <= 0)
+                return;
+        }
+        buffers.clear();
+        // Spectators have nothing to say, so readable means hung up (or junk
+        // to throw away). Checked without blocking between results.
+        FlexWait peer(1,&socket);
+        if (peer.Wait(FlexWait::POLL) == &socket)
+        {
+            ByteArray ignored;
+            if (socket.Read(ignored) <= 0)
+                return;
+        }
+    }
+}
+};
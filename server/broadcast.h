@@ -0,0 +1,73 @@
+#ifndef BROADCAST_H
+#define BROADCAST_H
+#include <stdint.h>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "socket.h"
+namespace Sync{
+
+// A message encoded once and shared, read-only, by every reader of it.
+typedef std::shared_ptr<const ByteArray> SharedBuffer;
+SharedBuffer MakeSharedBuffer(std::string const & message);
+
+// Fan-out point for one ordered stream of results, e.g. everything a lobby
+// publishes. Results sit in a single ring shared by all spectators; each
+// spectator keeps its own cursor into it. Publishing stores one pointer and
+// wakes every waiting spectator with one notify, so its cost does not grow
+// with the number of spectators. A spectator that falls a whole ring behind
+// skips the oldest results instead of holding anyone up.
+class SpectatorHub
+{
+private:
+    struct Entry
+    {
+        uint64_t sequence;  // 0 while the slot has never been written
+        SharedBuffer buffer;
+    };
+
+    std::mutex ringMutex;
+    std::condition_variable published;
+    std::vector<Entry> ring;
+    uint64_t visible;      // First sequence spectators can't see yet
+    size_t subscribers;
+    bool closed;
+
+public:
+    // One spectator's position in the hub's stream.
+    class Cursor
+    {
+        friend class SpectatorHub;
+    private:
+        std::shared_ptr<SpectatorHub> hub;
+        uint64_t position;
+        size_t dropped;
+        Cursor(Cursor const &);
+        Cursor & operator=(Cursor const &);
+    public:
+        // Starts at the next result published.
+        Cursor(std::shared_ptr<SpectatorHub> const & hub);
+        ~Cursor(void);
+        // Waits up to timeout for results past the cursor and appends them to
+        // buffers. Returns false once the hub is closed and nothing is left.
+        bool Wait(std::vector<SharedBuffer> & buffers, std::chrono::milliseconds timeout);
+        size_t Dropped(void) const {return dropped;}
+    };
+
+    SpectatorHub(size_t capacity = 64);
+    // Sequences start at 1 with no gaps. Publishers may race each other (they
+    // publish after letting go of the lobby lock), so a result can arrive
+    // before the one ahead of it; spectators still see them in order.
+    void Publish(uint64_t sequence, SharedBuffer const & buffer);
+    void Close(void);
+    size_t Count(void);
+};
+
+// Sends a spectator everything its cursor sees until the peer goes away or
+// the hub is closed. Anything the peer sends is discarded.
+void PumpSpectator(Socket & socket, SpectatorHub::Cursor & cursor);
+};
+#endif // BROADCAST_H
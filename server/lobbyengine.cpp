@@ -0,0 +1,249 @@
+#include "lobbyengine.h"
+#include "trace.h"
+
+using namespace Protocol;
+
+LobbyEngine::LobbyEngine(int id, LobbyOutput & o, TraceRecorder * r)
+    : lobbyId(id), output(o), recorder(r), playerCount(0), choiceCount(0), started(false), round(0)
+{
+    for (int i=0;i<MaxPlayers;i++)
+        slots[i] = Slot{false, false, 0, Move::None};
+}
+
+int LobbyEngine::Apply(LobbyEvent const & event)
+{
+    if (recorder)
+        recorder->Record(event);
+    switch (event.type)
+    {
+    case LobbyEvent::Join: return DoJoin(event.session);
+    case LobbyEvent::Choose: DoChoose(event.playerId, event.move); return 0;
+    case LobbyEvent::Leave: DoLeave(event.playerId); return 0;
+    case LobbyEvent::Disconnect: DoDisconnect(event.playerId); return 0;
+    case LobbyEvent::Resume: return DoResume(event.session);
+    case LobbyEvent::Resolve: DoResolve(); return 0;
+    }
+    return 0;
+}
+
+int LobbyEngine::Join(uint64_t session)
+{
+    LobbyEvent event;
+    event.type = LobbyEvent::Join;
+    event.lobbyId = lobbyId;
+    event.session = session;
+    return Apply(event);
+}
+
+void LobbyEngine::Choose(int playerId, Move move)
+{
+    LobbyEvent event;
+    event.type = LobbyEvent::Choose;
+    event.lobbyId = lobbyId;
+    event.playerId = playerId;
+    event.move = move;
+    Apply(event);
+}
+
+void LobbyEngine::Leave(int playerId)
+{
+    LobbyEvent event;
+    event.type = LobbyEvent::Leave;
+    event.lobbyId = lobbyId;
+    event.playerId = playerId;
+    Apply(event);
+}
+
+void LobbyEngine::Disconnect(int playerId)
+{
+    LobbyEvent event;
+    event.type = LobbyEvent::Disconnect;
+    event.lobbyId = lobbyId;
+    event.playerId = playerId;
+    Apply(event);
+}
+
+int LobbyEngine::Resume(uint64_t session)
+{
+    LobbyEvent event;
+    event.type = LobbyEvent::Resume;
+    event.lobbyId = lobbyId;
+    event.session = session;
+    return Apply(event);
+}
+
+void LobbyEngine::ForceResolve(void)
+{
+    LobbyEvent event;
+    event.type = LobbyEvent::Resolve;
+    event.lobbyId = lobbyId;
+    Apply(event);
+}
+
+bool LobbyEngine::Valid(int playerId) const
+{
+    return playerId >= 1 && playerId <= MaxPlayers;
+}
+
+bool LobbyEngine::IsPresent(int playerId) const
+{
+    return Valid(playerId) && slots[playerId-1].occupied;
+}
+
+bool LobbyEngine::IsConnected(int playerId) const
+{
+    return IsPresent(playerId) && slots[playerId-1].connected;
+}
+
+uint64_t LobbyEngine::Session(int playerId) const
+{
+    return IsPresent(playerId) ? slots[playerId-1].session : 0;
+}
+
+int LobbyEngine::DoJoin(uint64_t session)
+{
+    if (IsFull())
+        return 0;
+    for (int i=0;i<MaxPlayers;i++)
+    {
+        if (slots[i].occupied && slots[i].session == session)
+            return 0;
+    }
+    int playerId = 1;
+    while (slots[playerId-1].occupied)
+        playerId++;
+    slots[playerId-1] = Slot{true, true, session, Move::None};
+    playerCount++;
+    output.SendSession(playerId, session);
+
+    if (IsFull())
+    {
+        started = true;
+        for (int i=1;i<=MaxPlayers;i++)
+            output.SendStatus(i, Status::AllJoined, 0);
+    }
+    else
+        output.SendStatus(playerId, Status::WaitingForPlayer, 0);
+    return playerId;
+}
+
+void LobbyEngine::DoChoose(int playerId, Move move)
+{
+    if (!IsPresent(playerId))
+        return;
+    if (!started || move == Move::None || move > Move::Scissors)
+    {
+        output.SendStatus(playerId, Status::InvalidChoice, 0);
+        return;
+    }
+    Slot & slot = slots[playerId-1];
+    if (slot.choice == Move::None)
+        choiceCount++;
+    slot.choice = move;
+    if (choiceCount == playerCount)
+        Resolve();
+}
+
+void LobbyEngine::Resolve(void)
+{
+    ResultRecord record;
+    record.lobbyId = lobbyId;
+    record.round = ++round;
+    record.move1 = slots[0].occupied ? slots[0].choice : Move::None;
+    record.move2 = slots[1].occupied ? slots[1].choice : Move::None;
+
+    Move choice1 = record.move1;
+    Move choice2 = record.move2;
+    if (choice1 == Move::None || choice2 == Move::None)
+        record.outcome = Outcome::NoResponse;
+    else if (choice1 == choice2)
+        record.outcome = Outcome::Draw;
+    else if ((choice1 == Move::Rock && choice2 == Move::Scissors) ||
+             (choice1 == Move::Scissors && choice2 == Move::Paper) ||
+             (choice1 == Move::Paper && choice2 == Move::Rock))
+        record.outcome = Outcome::Player1Wins;
+    else
+        record.outcome = Outcome::Player2Wins;
+
+    for (int i=0;i<MaxPlayers;i++)
+        slots[i].choice = Move::None;
+    choiceCount = 0;
+    output.SendResult(record);
+}
+
+void LobbyEngine::DoLeave(int playerId)
+{
+    if (!IsPresent(playerId))
+        return;
+    Slot & slot = slots[playerId-1];
+    if (slot.choice != Move::None)
+        choiceCount--;
+    slot = Slot{false, false, 0, Move::None};
+    playerCount--;
+    for (int i=1;i<=MaxPlayers;i++)
+    {
+        if (IsPresent(i))
+            output.SendStatus(i, Status::PlayerLeft, playerId);
+    }
+    // Whoever is left may already have chosen; don't leave them waiting.
+    if (started && playerCount > 0 && choiceCount == playerCount)
+        Resolve();
+}
+
+void LobbyEngine::DoDisconnect(int playerId)
+{
+    if (IsPresent(playerId))
+        slots[playerId-1].connected = false;
+}
+
+int LobbyEngine::DoResume(uint64_t session)
+{
+    for (int i=1;i<=MaxPlayers;i++)
+    {
+        Slot & slot = slots[i-1];
+        if (slot.occupied && !slot.connected && slot.session == session)
+        {
+            slot.connected = true;
+            output.SendStatus(i, Status::Resumed, 0);
+            return i;
+        }
+    }
+    return 0;
+}
+
+void LobbyEngine::DoResolve(void)
+{
+    if (started && playerCount > 0)
+        Resolve();
+}
+
+void LobbyEngine::CheckInvariants(void) const
+{
+    int occupied = 0;
+    int chosen = 0;
+    for (int i=0;i<MaxPlayers;i++)
+    {
+        Slot const & slot = slots[i];
+        if (slot.occupied)
+            occupied++;
+        if (slot.choice != Move::None)
+        {
+            if (!slot.occupied)
+                throw std::string("Empty slot holds a choice");
+            chosen++;
+        }
+        if (!slot.occupied && slot.connected)
+            throw std::string("Empty slot marked connected");
+        for (int j=0;j<i;j++)
+        {
+            if (slot.occupied && slots[j].occupied && slot.session == slots[j].session)
+                throw std::string("Two players share a session");
+        }
+    }
+    if (occupied != playerCount)
+        throw std::string("Player count out of sync with slots");
+    if (chosen != choiceCount)
+        throw std::string("Choice count out of sync with slots");
+    if (playerCount > 0 && choiceCount == playerCount && started)
+        throw std::string("Round left unresolved");
+}
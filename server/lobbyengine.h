@@ -0,0 +1,107 @@
+#ifndef LOBBYENGINE_H
+#define LOBBYENGINE_H
+#include <stdint.h>
+
+#include "protocol.h"
+
+class TraceRecorder;
+
+// Everything that can happen to a lobby, in the order it happened. The server
+// feeds these to a LobbyEngine as they arrive; a recorded trace of them can be
+// fed back through LobbyReplay to reproduce the same run single-threaded.
+struct LobbyEvent
+{
+    enum Type : uint8_t
+    {
+        Join = 1,       // session
+        Choose = 2,     // playerId, move (Move::None for an invalid choice)
+        Leave = 3,      // playerId, said "done" or never came back
+        Disconnect = 4, // playerId, connection dropped
+        Resume = 5,     // session
+        Resolve = 6     // operator ended the round, missing choices count as no response
+    };
+
+    Type type;
+    int lobbyId;
+    int playerId;
+    Protocol::Move move;
+    uint64_t session;
+
+    LobbyEvent(void) : type(Join), lobbyId(0), playerId(0), move(Protocol::Move::None), session(0) {;}
+};
+
+// Where a lobby's messages go. The server implements this on top of its
+// connections and spectator hubs; the replayer just counts and checks them.
+class LobbyOutput
+{
+public:
+    virtual ~LobbyOutput(void) {;}
+    virtual void SendStatus(int playerId, Protocol::Status status, int argument) = 0;
+    virtual void SendSession(int playerId, uint64_t session) = 0;
+    // Goes to every player in the lobby and to its spectators.
+    virtual void SendResult(Protocol::ResultRecord const & record) = 0;
+};
+
+// The rules of one lobby with no sockets, threads or locks. Player ids are
+// fixed slots (1 and 2) for as long as the player stays, so a player leaving
+// never renumbers the other one. Not thread safe; the owner serializes calls.
+class LobbyEngine
+{
+public:
+    static const int MaxPlayers = 2;
+
+private:
+    struct Slot
+    {
+        bool occupied;
+        bool connected;
+        uint64_t session;
+        Protocol::Move choice;
+    };
+
+    int lobbyId;
+    LobbyOutput & output;
+    TraceRecorder * recorder;
+    Slot slots[MaxPlayers];
+    int playerCount;
+    int choiceCount;
+    bool started;
+    uint32_t round;
+
+    int DoJoin(uint64_t session);
+    void DoChoose(int playerId, Protocol::Move move);
+    void DoLeave(int playerId);
+    void DoDisconnect(int playerId);
+    int DoResume(uint64_t session);
+    void DoResolve(void);
+    void Resolve(void);
+    bool Valid(int playerId) const;
+
+public:
+    LobbyEngine(int lobbyId, LobbyOutput & output, TraceRecorder * recorder = nullptr);
+
+    // Applies one event. Returns the player id for Join and Resume (0 when the
+    // lobby is full or the session is unknown), 0 for everything else.
+    int Apply(LobbyEvent const & event);
+
+    int Join(uint64_t session);
+    void Choose(int playerId, Protocol::Move move);
+    void Leave(int playerId);
+    void Disconnect(int playerId);
+    int Resume(uint64_t session);
+    void ForceResolve(void);
+
+    int GetLobbyId(void) const {return lobbyId;}
+    int PlayerCount(void) const {return playerCount;}
+    bool IsFull(void) const {return playerCount == MaxPlayers;}
+    bool IsStarted(void) const {return started;}
+    uint32_t Round(void) const {return round;}
+    bool IsPresent(int playerId) const;
+    bool IsConnected(int playerId) const;
+    uint64_t Session(int playerId) const;
+
+    // Throws std::string describing the first broken invariant.
+    void CheckInvariants(void) const;
+};
+
+#endif // LOBBYENGINE_H
@@ -0,0 +1,54 @@
+#include "log.h"
+#include <atomic>
+#include <iostream>
+#include <mutex>
+
+static std::atomic<int> currentLevel((int)LogLevel::Info);
+static std::mutex outputMutex;
+
+static char const * const LevelNames[] = {"error", "warning", "info", "debug"};
+
+void SetLogLevel(LogLevel level)
+{
+    currentLevel.store((int)level, std::memory_order_relaxed);
+}
+
+LogLevel GetLogLevel(void)
+{
+    return (LogLevel)currentLevel.load(std::memory_order_relaxed);
+}
+
+std::string LogLevelName(LogLevel level)
+{
+    return LevelNames[(int)level];
+}
+
+bool ParseLogLevel(std::string const & name, LogLevel & level)
+{
+    for (int i=0;i<=(int)LogLevel::Debug;i++)
+    {
+        if (name == LevelNames[i])
+        {
+            level = (LogLevel)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+Log::Log(LogLevel l)
+    : level(l), enabled((int)l <= currentLevel.load(std::memory_order_relaxed))
+{
+    ;
+}
+
+Log::~Log(void)
+{
+    if (!enabled)
+        return;
+    line << '\n';
+    std::lock_guard<std::mutex> lock(outputMutex);
+    std::ostream & out = level <= LogLevel::Warning ? std::cerr : std::cout;
+    out << line.str();
+    out.flush();
+}
@@ -0,0 +1,40 @@
+#ifndef LOG_H
+#define LOG_H
+#include <sstream>
+#include <string>
+
+enum class LogLevel : int { Error, Warning, Info, Debug };
+
+// The level can be changed while the server runs; messages above it are not
+// even formatted.
+void SetLogLevel(LogLevel level);
+LogLevel GetLogLevel(void);
+std::string LogLevelName(LogLevel level);
+// Accepts the names returned by LogLevelName.
+bool ParseLogLevel(std::string const & name, LogLevel & level);
+
+// One log line, written out whole when the temporary goes away so lines from
+// different threads never interleave. Errors and warnings go to stderr.
+//
+//     Log(LogLevel::Info) << "Lobby " << id << " created";
+class Log
+{
+private:
+    LogLevel level;
+    bool enabled;
+    std::ostringstream line;
+    Log(Log const &);
+    Log & operator=(Log const &);
+public:
+    Log(LogLevel level);
+    ~Log(void);
+    template <typename T>
+    Log & operator<<(T const & value)
+    {
+        if (enabled)
+            line << value;
+        return *this;
+    }
+};
+
+#endif // LOG_H
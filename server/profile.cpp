@@ -0,0 +1,336 @@
+#include "profile.h"
+#include <sched.h>
+#include <stdio.h>
+#include <memory>
+
+namespace Sync{
+
+typedef std::chrono::steady_clock Clock;
+
+static std::mutex & LockRegistryMutex(void)
+{
+    static std::mutex registryMutex;
+    return registryMutex;
+}
+
+static std::vector<LockStats *> & LockRegistry(void)
+{
+    static std::vector<LockStats *> registry;
+    return registry;
+}
+
+LockStats::LockStats(char const * n)
+    : name(n)
+{
+    for (int shard=0;shard<ShardCount;shard++)
+    {
+        shards[shard].contended.store(0, std::memory_order_relaxed);
+        for (int i=0;i<MaxSites;i++)
+            shards[shard].sites[i].name.store(nullptr, std::memory_order_relaxed);
+    }
+    std::lock_guard<std::mutex> lock(LockRegistryMutex());
+    LockRegistry().push_back(this);
+}
+
+std::vector<LockStats *> AllLockStats(void)
+{
+    std::lock_guard<std::mutex> lock(LockRegistryMutex());
+    return LockRegistry();
+}
+
+LockStats::Shard & LockStats::LocalShard(void)
+{
+    // A thread that migrates afterwards still records correctly, only into
+    // a shard another core may be using too.
+    int cpu = sched_getcpu();
+    return shards[(cpu < 0 ? 0 : cpu) % ShardCount];
+}
+
+void LockStats::RecordWait(Clock::duration waited, bool wasContended)
+{
+    Shard & shard = LocalShard();
+    shard.wait.Record(waited);
+    if (wasContended)
+        shard.contended.fetch_add(1, std::memory_order_relaxed);
+}
+
+void LockStats::RecordHold(char const * site, Clock::duration held)
+{
+    Shard & shard = LocalShard();
+    shard.hold.Record(held);
+    int last = MaxSites - 1;
+    for (int i=0;i<last;i++)
+    {
+        char const * current = shard.sites[i].name.load(std::memory_order_acquire);
+        // On a lost race for a free entry, current ends up holding the winner
+        if (current == nullptr && shard.sites[i].name.compare_exchange_strong(current, site, std::memory_order_acq_rel))
+            current = site;
+        if (current == site)
+        {
+            shard.sites[i].hold.Record(held);
+            return;
+        }
+    }
+    shard.sites[last].name.store("other", std::memory_order_relaxed);
+    shard.sites[last].hold.Record(held);
+}
+
+std::string LockStats::Report(void) const
+{
+    // Sites fill each shard in their own order, so merge them by name.
+    LatencyHistogram wait;
+    LatencyHistogram hold;
+    uint64_t contended = 0;
+    std::vector<char const *> siteNames;
+    std::vector<std::unique_ptr<LatencyHistogram>> siteHolds;
+    for (int shard=0;shard<ShardCount;shard++)
+    {
+        Shard const & current = shards[shard];
+        contended += current.contended.load(std::memory_order_relaxed);
+        wait.Add(current.wait);
+        hold.Add(current.hold);
+        for (int i=0;i<MaxSites;i++)
+        {
+            char const * site = current.sites[i].name.load(std::memory_order_acquire);
+            if (!site)
+                continue;
+            size_t index = 0;
+            while (index < siteNames.size() && siteNames[index] != site)
+                index++;
+            if (index == siteNames.size())
+            {
+                siteNames.push_back(site);
+                siteHolds.emplace_back(new LatencyHistogram());
+            }
+            siteHolds[index]->Add(current.sites[i].hold);
+        }
+    }
+
+    LatencyHistogram::Summary waits = wait.Summarize();
+    std::string report = std::string(name) + " acquired " + std::to_string(waits.count) +
+        " contended " + std::to_string(contended) + "\n";
+    report += "  wait " + FormatSummary(waits) + "\n";
+    report += "  hold " + FormatSummary(hold.Summarize()) + "\n";
+    for (size_t i=0;i<siteNames.size();i++)
+        report += "  hold in " + std::string(siteNames[i]) + " " + FormatSummary(siteHolds[i]->Summarize()) + "\n";
+    return report;
+}
+
+void LockStats::Reset(void)
+{
+    for (int shard=0;shard<ShardCount;shard++)
+    {
+        shards[shard].contended.store(0, std::memory_order_relaxed);
+        shards[shard].wait.Reset();
+        shards[shard].hold.Reset();
+        for (int i=0;i<MaxSites;i++)
+            shards[shard].sites[i].hold.Reset();
+    }
+}
+
+ProfiledMutex::ProfiledMutex(LockStats & s)
+    : stats(s), site(nullptr)
+{
+    ;
+}
+
+void ProfiledMutex::Lock(char const * lockSite)
+{
+    Clock::time_point start = Clock::now();
+    bool wasContended = !mutex.try_lock();
+    if (wasContended)
+        mutex.lock();
+    acquired = Clock::now();
+    site = lockSite;
+    stats.RecordWait(acquired - start, wasContended);
+    if (wasContended && IsTracing())
+        RecordSpan(stats.GetName(), "lock wait", start, acquired - start);
+}
+
+void ProfiledMutex::Unlock(void)
+{
+    // Copy out what the next owner will overwrite, then let it in before
+    // spending time on bookkeeping.
+    Clock::time_point start = acquired;
+    char const * lockSite = site;
+    Clock::duration held = Clock::now() - start;
+    mutex.unlock();
+    stats.RecordHold(lockSite, held);
+    if (IsTracing())
+        RecordSpan(lockSite, stats.GetName(), start, held);
+}
+
+ProfiledLock::ProfiledLock(ProfiledMutex & m, char const * site)
+    : mutex(m), owned(true)
+{
+    mutex.Lock(site);
+}
+
+ProfiledLock::~ProfiledLock(void)
+{
+    Unlock();
+}
+
+void ProfiledLock::Unlock(void)
+{
+    if (owned)
+    {
+        owned = false;
+        mutex.Unlock();
+    }
+}
+
+// Each thread appends to its own buffer; the buffer's mutex is only ever
+// contended by an export. Buffers outlive their threads in the registry so
+// spans from finished connections still make it into the export.
+struct Span
+{
+    char const * name;
+    char const * category;
+    int64_t startMicros;
+    int64_t durationMicros;
+    int64_t lobbyId;
+};
+
+struct ThreadBuffer
+{
+    std::mutex mutex;
+    std::vector<Span> spans;
+    int threadId;
+};
+
+static const size_t MaxSpansPerThread = 1 << 18;
+
+static std::atomic<bool> tracing(false);
+static std::atomic<uint64_t> dropped(0);
+static std::atomic<int> nextThreadId(1);
+static std::mutex buffersMutex;
+static std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+
+static ThreadBuffer & LocalBuffer(void)
+{
+    thread_local std::shared_ptr<ThreadBuffer> buffer;
+    if (!buffer)
+    {
+        buffer = std::make_shared<ThreadBuffer>();
+        buffer->threadId = nextThreadId.fetch_add(1, std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lock(buffersMutex);
+        buffers.push_back(buffer);
+    }
+    return *buffer;
+}
+
+static int64_t Micros(Clock::duration duration)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+}
+
+void StartTracing(void)
+{
+    std::lock_guard<std::mutex> lock(buffersMutex);
+    std::vector<std::shared_ptr<ThreadBuffer>> live;
+    for (auto& buffer : buffers)
+    {
+        // Only the registry still holds buffers of threads that have exited
+        if (buffer.use_count() > 1)
+        {
+            std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+            buffer->spans.clear();
+            live.push_back(buffer);
+        }
+    }
+    buffers.swap(live);
+    dropped.store(0, std::memory_order_relaxed);
+    tracing.store(true, std::memory_order_release);
+}
+
+void StopTracing(void)
+{
+    tracing.store(false, std::memory_order_release);
+}
+
+bool IsTracing(void)
+{
+    return tracing.load(std::memory_order_relaxed);
+}
+
+uint64_t DroppedSpans(void)
+{
+    return dropped.load(std::memory_order_relaxed);
+}
+
+void RecordSpan(char const * name, char const * category, Clock::time_point start,
+                Clock::duration duration, int64_t lobbyId)
+{
+    ThreadBuffer & buffer = LocalBuffer();
+    std::lock_guard<std::mutex> lock(buffer.mutex);
+    if (buffer.spans.size() >= MaxSpansPerThread)
+    {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    buffer.spans.push_back(Span{name, category, Micros(start.time_since_epoch()), Micros(duration), lobbyId});
+}
+
+static void WriteJsonString(FILE * file, char const * text)
+{
+    fputc('"', file);
+    for (char const * p = text ? text : "?"; *p; p++)
+    {
+        if (*p == '"' || *p == '\\')
+            fputc('\\', file);
+        fputc(*p, file);
+    }
+    fputc('"', file);
+}
+
+size_t ExportChromeTrace(std::string const & path)
+{
+    FILE * file = fopen(path.c_str(), "w");
+    if (!file)
+        throw std::string("Unable to open trace file ") + path;
+
+    std::vector<std::shared_ptr<ThreadBuffer>> snapshot;
+    {
+        std::lock_guard<std::mutex> lock(buffersMutex);
+        snapshot = buffers;
+    }
+    size_t count = 0;
+    fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", file);
+    for (auto& buffer : snapshot)
+    {
+        std::lock_guard<std::mutex> lock(buffer->mutex);
+        for (Span const & span : buffer->spans)
+        {
+            fputs(count++ ? ",\n" : "\n", file);
+            fputs("{\"name\":", file);
+            WriteJsonString(file, span.name);
+            fputs(",\"cat\":", file);
+            WriteJsonString(file, span.category);
+            fprintf(file, ",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%lld,\"dur\":%lld",
+                    buffer->threadId, (long long)span.startMicros, (long long)span.durationMicros);
+            if (span.lobbyId >= 0)
+                fprintf(file, ",\"args\":{\"lobby\":%lld}", (long long)span.lobbyId);
+            fputc('}', file);
+        }
+    }
+    fputs("\n]}\n", file);
+    bool failed = ferror(file) != 0;
+    if (fclose(file) != 0 || failed)
+        throw std::string("Unable to write trace file ") + path;
+    return count;
+}
+
+TraceSpan::TraceSpan(char const * n, int64_t id)
+    : name(n), lobbyId(id), active(IsTracing())
+{
+    if (active)
+        start = Clock::now();
+}
+
+TraceSpan::~TraceSpan(void)
+{
+    if (active)
+        RecordSpan(name, "request", start, Clock::now() - start, lobbyId);
+}
+};
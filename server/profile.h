@@ -0,0 +1,132 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "stats.h"
+namespace Sync{
+
+// Wait and hold times for one kind of lock, e.g. every lobby's playersMutex
+// together. Hold times are also kept per hold-site, the function that took
+// the lock, so a slow holder can be told apart from a busy lock. Sites are
+// matched by pointer, so pass __func__ or another string literal.
+//
+// Every lock and unlock records into the shard of the CPU it runs on, so
+// cores taking different locks of the same kind don't fight over the
+// counters' cache lines; Report() merges the shards.
+class LockStats
+{
+public:
+    static const int MaxSites = 32;  // Sites past this are lumped together as "other"
+    static const int ShardCount = 16;
+
+private:
+    struct Site
+    {
+        std::atomic<char const *> name;
+        LatencyHistogram hold;
+    };
+
+    struct alignas(64) Shard
+    {
+        std::atomic<uint64_t> contended;
+        LatencyHistogram wait;
+        LatencyHistogram hold;
+        Site sites[MaxSites];
+    };
+
+    char const * name;
+    Shard shards[ShardCount];
+
+    Shard & LocalShard(void);
+
+    LockStats(LockStats const &);
+    LockStats & operator=(LockStats const &);
+
+public:
+    // Registers itself for AllLockStats(); meant to live as long as the program.
+    LockStats(char const * name);
+    char const * GetName(void) const {return name;}
+    void RecordWait(std::chrono::steady_clock::duration waited, bool wasContended);
+    void RecordHold(char const * site, std::chrono::steady_clock::duration held);
+    // Multi-line report: totals, then hold times per site.
+    std::string Report(void) const;
+    void Reset(void);
+};
+
+std::vector<LockStats *> AllLockStats(void);
+
+// A std::mutex that reports to a LockStats. The time of acquisition lives in
+// the mutex itself; only the owner touches it.
+class ProfiledMutex
+{
+private:
+    std::mutex mutex;
+    LockStats & stats;
+    std::chrono::steady_clock::time_point acquired;
+    char const * site;
+
+    ProfiledMutex(ProfiledMutex const &);
+    ProfiledMutex & operator=(ProfiledMutex const &);
+
+public:
+    ProfiledMutex(LockStats & stats);
+    void Lock(char const * site);
+    void Unlock(void);
+};
+
+// Scoped owner of a ProfiledMutex, the counterpart of std::unique_lock.
+class ProfiledLock
+{
+private:
+    ProfiledMutex & mutex;
+    bool owned;
+
+    ProfiledLock(ProfiledLock const &);
+    ProfiledLock & operator=(ProfiledLock const &);
+
+public:
+    ProfiledLock(ProfiledMutex & mutex, char const * site);
+    ~ProfiledLock(void);
+    void Unlock(void);
+};
+
+// Span tracing. While on, every TraceSpan, lock wait and lock hold becomes a
+// complete event in a per-thread buffer; exporting writes them out as Chrome
+// trace-event JSON (chrome://tracing, Perfetto). While off, a span costs one
+// relaxed atomic load.
+void StartTracing(void);
+void StopTracing(void);
+bool IsTracing(void);
+// Writes everything recorded since StartTracing() and returns the event count.
+// Throws std::string if the file can't be written.
+size_t ExportChromeTrace(std::string const & path);
+// Spans thrown away because a thread's buffer was full.
+uint64_t DroppedSpans(void);
+
+void RecordSpan(char const * name, char const * category, std::chrono::steady_clock::time_point start,
+                std::chrono::steady_clock::duration duration, int64_t lobbyId = -1);
+
+// Times the enclosing scope. Names must be string literals.
+class TraceSpan
+{
+private:
+    char const * name;
+    int64_t lobbyId;
+    bool active;
+    std::chrono::steady_clock::time_point start;
+
+    TraceSpan(TraceSpan const &);
+    TraceSpan & operator=(TraceSpan const &);
+
+public:
+    TraceSpan(char const * name, int64_t lobbyId = -1);
+    ~TraceSpan(void);
+    void SetLobby(int64_t id) {lobbyId = id;}
+};
+};
+#endif // PROFILE_H
@@ -0,0 +1,402 @@
+#include "protocol.h"
+#include "session.h"
+#include <algorithm>
+#include <stdexcept>
+
+using namespace Sync;
+
+namespace Protocol {
+
+std::string MoveName(Move move)
+{
+    switch (move)
+    {
+    case Move::Rock: return "rock";
+    case Move::Paper: return "paper";
+    case Move::Scissors: return "scissors";
+    default: return "none";
+    }
+}
+
+std::string OutcomeText(Outcome outcome)
+{
+    switch (outcome)
+    {
+    case Outcome::Draw: return "Draw";
+    case Outcome::Player1Wins: return "Player 1 wins!";
+    case Outcome::Player2Wins: return "Player 2 wins!";
+    default: return "Both players did not respond.";
+    }
+}
+
+void PutVarint(std::vector<char> & out, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        out.push_back((char)((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out.push_back((char)value);
+}
+
+size_t GetVarint(char const * in, size_t size, uint64_t & value)
+{
+    value = 0;
+    for (size_t i=0;i<size && i<10;i++)
+    {
+        uint8_t byte = (uint8_t)in[i];
+        value |= (uint64_t)(byte & 0x7F) << (7*i);
+        if (!(byte & 0x80))
+            return i+1;
+    }
+    return 0;
+}
+
+static void PutU32(std::vector<char> & out, uint32_t value)
+{
+    for (int i=0;i<4;i++)
+        out.push_back((char)((value >> (8*i)) & 0xFF));
+}
+
+static void PutU64(std::vector<char> & out, uint64_t value)
+{
+    for (int i=0;i<8;i++)
+        out.push_back((char)((value >> (8*i)) & 0xFF));
+}
+
+static uint32_t GetU32(char const * in)
+{
+    uint32_t value = 0;
+    for (int i=0;i<4;i++)
+        value |= (uint32_t)(uint8_t)in[i] << (8*i);
+    return value;
+}
+
+static uint64_t GetU64(char const * in)
+{
+    uint64_t value = 0;
+    for (int i=0;i<8;i++)
+        value |= (uint64_t)(uint8_t)in[i] << (8*i);
+    return value;
+}
+
+static void PutFrame(ByteArray & frame, uint8_t opcode, std::vector<char> const & payload)
+{
+    frame.v.reserve(1 + 2 + payload.size());
+    frame.v.push_back((char)opcode);
+    PutVarint(frame.v, payload.size());
+    frame.v.insert(frame.v.end(), payload.begin(), payload.end());
+}
+
+ByteArray EncodeHelloAck(uint8_t version)
+{
+    ByteArray frame;
+    PutFrame(frame, OpHelloAck, std::vector<char>(1, (char)version));
+    return frame;
+}
+
+// Text messages are lines, so back to back messages can be told apart.
+static ByteArray TextMessage(std::string const & text)
+{
+    return ByteArray(text + "\n");
+}
+
+static std::string StatusText(Status status, int argument)
+{
+    switch (status)
+    {
+    case Status::WaitingForPlayer: return "Waiting for one more player";
+    case Status::AllJoined: return "All players have joined";
+    case Status::NoLobbyAvailable: return "No available lobby to join. Please try creating a new one.";
+    case Status::InvalidChoice: return "Invalid choice. Try again.";
+    case Status::PlayerLeft: return "Player " + std::to_string(argument) + " has left the lobby.";
+    case Status::Spectating: return "Spectating lobby " + std::to_string(argument);
+    case Status::NoSuchLobby: return "No lobby with ID " + std::to_string(argument) + ".";
+    case Status::Resumed: return "Session resumed";
+    case Status::ResumeFailed: return "Unable to resume session.";
+    default: return "Invalid lobby ID.";
+    }
+}
+
+ByteArray EncodeStatus(Wire wire, Status status, int argument)
+{
+    if (wire == Wire::Text)
+        return TextMessage(StatusText(status, argument));
+
+    std::vector<char> payload;
+    payload.push_back((char)status);
+    PutVarint(payload, (uint64_t)argument);
+    ByteArray frame;
+    PutFrame(frame, OpStatus, payload);
+    return frame;
+}
+
+ByteArray EncodeResult(Wire wire, ResultRecord const & record)
+{
+    if (wire == Wire::Text)
+        return TextMessage("The result is " + OutcomeText(record.outcome) + ", Good game!");
+
+    std::vector<char> payload;
+    payload.reserve(ResultRecordSize);
+    PutU32(payload, record.lobbyId);
+    PutU32(payload, record.round);
+    payload.push_back((char)record.move1);
+    payload.push_back((char)record.move2);
+    payload.push_back((char)record.outcome);
+    ByteArray frame;
+    PutFrame(frame, OpResult, payload);
+    return frame;
+}
+
+ByteArray EncodeSession(Wire wire, SessionToken const & token)
+{
+    if (wire == Wire::Text)
+        return TextMessage("Session " + SessionTable::Format(token));
+
+    std::vector<char> payload;
+    PutU32(payload, token.index);
+    PutU64(payload, token.tag);
+    ByteArray frame;
+    PutFrame(frame, OpSession, payload);
+    return frame;
+}
+
+static Move ParseMove(std::string const & word)
+{
+    if (word == "rock")
+        return Move::Rock;
+    if (word == "paper")
+        return Move::Paper;
+    if (word == "scissors")
+        return Move::Scissors;
+    return Move::None;
+}
+
+Request ParseText(std::string const & message)
+{
+    static const std::string spectateCommand = "spectate ";
+    static const std::string resumeCommand = "resume ";
+    Request request;
+    if (message == "create")
+        request.command = Command::Create;
+    else if (message == "join")
+        request.command = Command::Join;
+    else if (message == "done")
+        request.command = Command::Done;
+    else if (message.compare(0, spectateCommand.size(), spectateCommand) == 0)
+    {
+        request.command = Command::Spectate;
+        try {
+            request.lobbyId = std::stoi(message.substr(spectateCommand.size()));
+        } catch (const std::exception &) {
+            request.lobbyId = -1;
+        }
+    }
+    else if (message.compare(0, resumeCommand.size(), resumeCommand) == 0)
+    {
+        if (SessionTable::Parse(message.substr(resumeCommand.size()), request.token))
+            request.command = Command::Resume;
+    }
+    else
+    {
+        request.move = ParseMove(message);
+        if (request.move != Move::None)
+            request.command = Command::Choice;
+    }
+    return request;
+}
+
+void FrameReader::Feed(char const * data, size_t size)
+{
+    // Drop consumed frames before appending; whatever is left is at most
+    // one partial frame, so this stays a short move.
+    if (start > 0)
+    {
+        buffer.erase(buffer.begin(), buffer.begin() + start);
+        start = 0;
+    }
+    buffer.insert(buffer.end(), data, data + size);
+}
+
+bool FrameReader::Next(uint8_t & opcode, std::string & payload)
+{
+    size_t available = buffer.size() - start;
+    if (available < 2)
+        return false;
+    uint64_t length = 0;
+    size_t lengthBytes = GetVarint(&buffer[start+1], available-1, length);
+    if (lengthBytes == 0 && available - 1 >= 10)
+        corrupt = true;
+    if (length > MaxPayloadSize)
+        corrupt = true;
+    if (corrupt || lengthBytes == 0 || available < 1 + lengthBytes + length)
+        return false;
+    opcode = (uint8_t)buffer[start];
+    char const * body = &buffer[start + 1 + lengthBytes];
+    payload.assign(body, body + length);
+    start += 1 + lengthBytes + length;
+    return true;
+}
+
+Request ParseFrame(uint8_t opcode, std::string const & payload)
+{
+    Request request;
+    switch (opcode)
+    {
+    case OpCreate:
+        request.command = Command::Create;
+        break;
+    case OpJoin:
+        request.command = Command::Join;
+        break;
+    case OpDone:
+        request.command = Command::Done;
+        break;
+    case OpSpectate:
+    {
+        uint64_t lobbyId = 0;
+        request.command = Command::Spectate;
+        if (GetVarint(payload.data(), payload.size(), lobbyId) == 0 || lobbyId > INT32_MAX)
+            request.lobbyId = -1;
+        else
+            request.lobbyId = (int)lobbyId;
+        break;
+    }
+    case OpResume:
+        if (payload.size() == 12)
+        {
+            request.command = Command::Resume;
+            request.token = SessionToken(GetU32(payload.data()), GetU64(payload.data() + 4));
+        }
+        break;
+    case OpChoice:
+        if (payload.size() == 1 && payload[0] >= (char)Move::Rock && payload[0] <= (char)Move::Scissors)
+        {
+            request.command = Command::Choice;
+            request.move = (Move)payload[0];
+        }
+        break;
+    default:
+        break;
+    }
+    return request;
+}
+
+Connection::Connection(Socket && s)
+    : socket(std::move(s)), wire(Wire::Text), hasPendingText(false), messageRate{0, 0}, limited(false), dropped(0)
+{
+    ;
+}
+
+void Connection::Limit(Rate rate, std::shared_ptr<Admission> a)
+{
+    messageRate = rate;
+    admission = a;
+    limited = true;
+}
+
+bool Connection::Allow(void)
+{
+    if (!limited)
+        return true;
+    if (messageBucket.Take(NowMilliseconds(), messageRate) && (!admission || admission->TakeMessage()))
+    {
+        dropped = 0;
+        return true;
+    }
+    dropped++;
+    return false;
+}
+
+bool Connection::Negotiate(void)
+{
+    ByteArray data;
+    if (socket.Read(data) <= 0)
+        return false;
+
+    if ((uint8_t)data.v[0] == HelloMagic)
+    {
+        // Wait for the version byte if the hello was split across reads.
+        while (data.v.size() < 2)
+        {
+            ByteArray more;
+            if (socket.Read(more) <= 0)
+                return false;
+            data.v.insert(data.v.end(), more.v.begin(), more.v.end());
+        }
+        if ((uint8_t)data.v[1] < MinVersion)
+            return false;
+        uint8_t version = std::min((uint8_t)data.v[1], Version);
+        wire = Wire::Binary;
+        socket.Write(EncodeHelloAck(version));
+        if (data.v.size() > 2)
+            frames.Feed(&data.v[2], data.v.size() - 2);
+        return true;
+    }
+
+    wire = Wire::Text;
+    pendingText.assign(data.v.begin(), data.v.end());
+    hasPendingText = true;
+    return true;
+}
+
+bool Connection::ReadRequest(Request & request)
+{
+    if (wire == Wire::Text)
+    {
+        if (hasPendingText)
+        {
+            hasPendingText = false;
+            request = ParseText(pendingText);
+            return true;
+        }
+        ByteArray data;
+        do
+        {
+            if (dropped > MaxDropped || socket.Read(data) <= 0)
+                return false;
+        } while (!Allow());
+        request = ParseText(std::string(data.v.begin(), data.v.end()));
+        return true;
+    }
+
+    uint8_t opcode;
+    std::string payload;
+    do
+    {
+        while (!frames.Next(opcode, payload))
+        {
+            if (frames.IsCorrupt())
+                return false;
+            ByteArray data;
+            if (socket.Read(data) <= 0)
+                return false;
+            frames.Feed(data.v.data(), data.v.size());
+        }
+        if (dropped > MaxDropped)
+            return false;
+    } while (!Allow());
+    request = ParseFrame(opcode, payload);
+    return true;
+}
+
+int Connection::Send(ByteArray const & buffer)
+{
+    return socket.Write(buffer);
+}
+
+int Connection::SendStatus(Status status, int argument)
+{
+    return socket.Write(EncodeStatus(wire, status, argument));
+}
+
+int Connection::SendSession(SessionToken const & token)
+{
+    return socket.Write(EncodeSession(wire, token));
+}
+
+void Connection::Interrupt(void)
+{
+    socket.Interrupt();
+}
+};
@@ -0,0 +1,165 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+#include <stdint.h>
+#include <memory>
+#include <string>
+
+#include "socket.h"
+#include "ratelimit.h"
+#include "session.h"
+
+// Wire protocol spoken between the server and its clients.
+//
+// Text clients (Client.cpp, client/main.py) send bare words such as "create"
+// or "rock", one command per write, and get human readable sentences back.
+// Each sentence ends in a newline; a single read may carry several of them,
+// e.g. the session token and the status that follows a join.
+//
+// Binary clients open with a two byte hello, HelloMagic followed by the
+// highest version they speak, and the server answers with OpHelloAck and the
+// version it picked. A client that only speaks versions older than
+// MinVersion is disconnected without an answer. After that every message in
+// either direction is a frame:
+//
+//     opcode (1 byte) | payload length (varint) | payload
+//
+// Varints are unsigned LEB128. Result payloads are a fixed 11 byte record:
+// lobby id (u32 LE), round (u32 LE), move 1, move 2, outcome.
+namespace Protocol {
+
+const uint8_t Version = 1;
+const uint8_t MinVersion = 1;
+const uint8_t HelloMagic = 0xB5;  // Never the first byte of a text command
+
+enum Opcode : uint8_t
+{
+    // Client to server
+    OpCreate = 0x01,    // empty
+    OpJoin = 0x02,      // empty
+    OpSpectate = 0x03,  // varint lobby id
+    OpChoice = 0x04,    // 1 byte Move
+    OpDone = 0x05,      // empty
+    OpResume = 0x06,    // u32 LE session index, u64 LE session tag
+    // Server to client
+    OpHelloAck = 0x80,  // 1 byte version
+    OpStatus = 0x81,    // 1 byte Status, varint argument
+    OpResult = 0x82,    // ResultRecord
+    OpSession = 0x83    // u32 LE session index, u64 LE session tag
+};
+
+enum class Wire : uint8_t { Text, Binary };
+
+enum class Command : uint8_t { Unknown, Create, Join, Spectate, Choice, Done, Resume };
+
+enum class Move : uint8_t { None, Rock, Paper, Scissors };
+
+enum class Outcome : uint8_t { Draw, Player1Wins, Player2Wins, NoResponse };
+
+enum class Status : uint8_t
+{
+    WaitingForPlayer,
+    AllJoined,
+    NoLobbyAvailable,
+    InvalidChoice,
+    PlayerLeft,       // argument: player id
+    Spectating,       // argument: lobby id
+    NoSuchLobby,      // argument: lobby id
+    InvalidLobbyId,
+    Resumed,
+    ResumeFailed
+};
+
+struct Request
+{
+    Command command;
+    Move move;
+    int lobbyId;
+    SessionToken token;
+    Request(void) : command(Command::Unknown), move(Move::None), lobbyId(0) {;}
+};
+
+struct ResultRecord
+{
+    uint32_t lobbyId;
+    uint32_t round;
+    Move move1;
+    Move move2;
+    Outcome outcome;
+};
+const size_t ResultRecordSize = 11;
+
+std::string MoveName(Move move);
+std::string OutcomeText(Outcome outcome);
+
+void PutVarint(std::vector<char> & out, uint64_t value);
+// Returns the number of bytes consumed, or 0 if the varint is incomplete.
+size_t GetVarint(char const * in, size_t size, uint64_t & value);
+
+Sync::ByteArray EncodeHelloAck(uint8_t version);
+Sync::ByteArray EncodeStatus(Wire wire, Status status, int argument = 0);
+Sync::ByteArray EncodeResult(Wire wire, ResultRecord const & record);
+Sync::ByteArray EncodeSession(Wire wire, SessionToken const & token);
+
+Request ParseText(std::string const & message);
+
+// Accumulates bytes from a stream socket and splits them into frames.
+class FrameReader
+{
+private:
+    std::vector<char> buffer;
+    size_t start;
+    bool corrupt;
+public:
+    static const size_t MaxPayloadSize = 1024;
+    FrameReader(void) : start(0), corrupt(false) {;}
+    void Feed(char const * data, size_t size);
+    // Pops the next complete frame, leaving partial ones buffered.
+    bool Next(uint8_t & opcode, std::string & payload);
+    // Set once a malformed or oversized frame has been seen.
+    bool IsCorrupt(void) const {return corrupt;}
+};
+
+Request ParseFrame(uint8_t opcode, std::string const & payload);
+
+// A client socket together with the protocol it negotiated.
+class Connection
+{
+private:
+    Sync::Socket socket;
+    Wire wire;
+    FrameReader frames;
+    std::string pendingText;
+    bool hasPendingText;
+    std::shared_ptr<Sync::Admission> admission;
+    Sync::TokenBucket messageBucket;
+    Sync::Rate messageRate;
+    bool limited;
+    unsigned dropped;   // Consecutive requests over the limit
+    bool Allow(void);
+public:
+    // Over-limit messages in a row tolerated before the connection is cut.
+    static const unsigned MaxDropped = 64;
+
+    Connection(Sync::Socket && socket);
+    // Charges every later request to a per-connection bucket and to the
+    // peer's source address. Requests over either limit are dropped unparsed.
+    void Limit(Sync::Rate rate, std::shared_ptr<Sync::Admission> admission);
+    // Reads the first message and settles on a wire format. Returns false if
+    // the peer went away before saying anything or offered no version the
+    // server speaks.
+    bool Negotiate(void);
+    // Blocks until a whole request arrives. Returns false on disconnect.
+    bool ReadRequest(Request & request);
+    int Send(Sync::ByteArray const & buffer);
+    int SendStatus(Status status, int argument = 0);
+    int SendSession(SessionToken const & token);
+    // Safe from any thread: wakes a reader blocked on this connection, which
+    // then sees it as disconnected.
+    void Interrupt(void);
+    Wire GetWire(void) const {return wire;}
+    // Requests dropped since the last one that was let through.
+    unsigned Dropped(void) const {return dropped;}
+    Sync::Socket & GetSocket(void) {return socket;}
+};
+};
+#endif // PROTOCOL_H
@@ -0,0 +1,184 @@
+#include "ratelimit.h"
+#include <chrono>
+#include <string.h>
+
+namespace Sync{
+
+uint32_t NowMilliseconds(void)
+{
+    return (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool TokenBucket::Take(uint32_t now, Rate const & rate)
+{
+    uint64_t capacity = (uint64_t)rate.burst * 1000;
+    uint64_t current = state.load(std::memory_order_relaxed);
+    while (true)
+    {
+        uint64_t tokens = current & 0xFFFFFFFF;
+        uint32_t last = (uint32_t)(current >> 32);
+        if (current == 0)
+            tokens = capacity;
+        else
+            tokens += (uint64_t)(uint32_t)(now - last) * rate.perSecond;
+        if (tokens > capacity)
+            tokens = capacity;
+        if (tokens < 1000)
+            return false;
+        uint64_t next = ((uint64_t)now << 32) | (tokens - 1000);
+        if (next == 0)
+            next = 1;  // Zero means "full", keep an empty bucket empty
+        if (state.compare_exchange_weak(current, next, std::memory_order_relaxed))
+            return true;
+    }
+}
+
+// Spreads addresses over the table; also keeps the key away from 0, which
+// marks a free slot.
+static uint64_t Mix(uint64_t value)
+{
+    value ^= value >> 33;
+    value *= 0xFF51AFD7ED558CCDull;
+    value ^= value >> 33;
+    value *= 0xC4CEB9FE1A85EC53ull;
+    value ^= value >> 33;
+    return value ? value : 1;
+}
+
+static bool SourceKey(Endpoint const & peer, uint64_t & key)
+{
+    if (peer.Family() == AF_INET)
+    {
+        sockaddr_in const * v4 = (sockaddr_in const*)&peer.address;
+        key = Mix((1ull << 32) | ntohl(v4->sin_addr.s_addr));
+        return true;
+    }
+    if (peer.Family() == AF_INET6)
+    {
+        sockaddr_in6 const * v6 = (sockaddr_in6 const*)&peer.address;
+        // IPv4 clients of a dual-stack listener share the ::ffff:0:0/96
+        // prefix; key them on their own address, as if they came in over v4.
+        if (IN6_IS_ADDR_V4MAPPED(&v6->sin6_addr))
+        {
+            uint32_t address;
+            memcpy(&address, v6->sin6_addr.s6_addr + 12, sizeof(address));
+            key = Mix((1ull << 32) | ntohl(address));
+            return true;
+        }
+        uint64_t prefix;
+        memcpy(&prefix, v6->sin6_addr.s6_addr, sizeof(prefix));
+        key = Mix(prefix ^ 0x6666666666666666ull);
+        return true;
+    }
+    return false;
+}
+
+Admission::Admission(SourceLimiter & l, void * s)
+    : limiter(l), slot(s)
+{
+    ;
+}
+
+Admission::~Admission(void)
+{
+    limiter.Release((SourceLimiter::Slot*)slot);
+}
+
+bool Admission::TakeMessage(void)
+{
+    if (!slot)
+        return true;
+    SourceLimiter::Slot * entry = (SourceLimiter::Slot*)slot;
+    uint32_t now = NowMilliseconds();
+    entry->lastSeen.store(now, std::memory_order_relaxed);
+    return entry->messages.Take(now, limiter.limits.messages);
+}
+
+SourceLimiter::SourceLimiter(Limits const & l, size_t perShard)
+    : limits(l), slotsPerShard(1), total(0), rejected(0)
+{
+    while (slotsPerShard < perShard)
+        slotsPerShard <<= 1;
+    for (int i=0;i<ShardCount;i++)
+    {
+        shards[i].slots.reset(new Slot[slotsPerShard]);
+        for (size_t j=0;j<slotsPerShard;j++)
+        {
+            shards[i].slots[j].key.store(0, std::memory_order_relaxed);
+            shards[i].slots[j].connections.store(0, std::memory_order_relaxed);
+            shards[i].slots[j].lastSeen.store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
+// Finds the source's slot, claiming a free or long idle one on first sight.
+// Returns null only when every slot in the probe window belongs to an active
+// source, in which case the peer goes untracked rather than refused.
+SourceLimiter::Slot * SourceLimiter::Find(uint64_t key, uint32_t now)
+{
+    Shard & shard = shards[key >> 60];
+    for (int i=0;i<MaxProbe;i++)
+    {
+        Slot & slot = shard.slots[(key + i) & (slotsPerShard - 1)];
+        uint64_t current = slot.key.load(std::memory_order_acquire);
+        if (current == key)
+            return &slot;
+        bool reusable = current != 0 &&
+            slot.connections.load(std::memory_order_relaxed) == 0 &&
+            (uint32_t)(now - slot.lastSeen.load(std::memory_order_relaxed)) > IdleMilliseconds;
+        if ((current == 0 || reusable) &&
+            slot.key.compare_exchange_strong(current, key, std::memory_order_acq_rel))
+        {
+            slot.connects.Reset();
+            slot.messages.Reset();
+            slot.lastSeen.store(now, std::memory_order_relaxed);
+            return &slot;
+        }
+        if (current == key)
+            return &slot;  // Another thread claimed it for the same source
+    }
+    return nullptr;
+}
+
+std::shared_ptr<Admission> SourceLimiter::Admit(Endpoint const & peer)
+{
+    if (total.fetch_add(1, std::memory_order_relaxed) >= limits.maxTotal)
+    {
+        total.fetch_sub(1, std::memory_order_relaxed);
+        rejected.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    uint64_t key;
+    Slot * slot = nullptr;
+    if (SourceKey(peer, key))
+    {
+        uint32_t now = NowMilliseconds();
+        slot = Find(key, now);
+        if (slot)
+        {
+            slot->lastSeen.store(now, std::memory_order_relaxed);
+            if (slot->connections.fetch_add(1, std::memory_order_relaxed) >= limits.maxPerSource ||
+                !slot->connects.Take(now, limits.connects))
+            {
+                slot->connections.fetch_sub(1, std::memory_order_relaxed);
+                total.fetch_sub(1, std::memory_order_relaxed);
+                rejected.fetch_add(1, std::memory_order_relaxed);
+                return nullptr;
+            }
+        }
+    }
+    return std::shared_ptr<Admission>(new Admission(*this, slot));
+}
+
+void SourceLimiter::Release(Slot * slot)
+{
+    if (slot)
+    {
+        slot->lastSeen.store(NowMilliseconds(), std::memory_order_relaxed);
+        slot->connections.fetch_sub(1, std::memory_order_relaxed);
+    }
+    total.fetch_sub(1, std::memory_order_relaxed);
+}
+};
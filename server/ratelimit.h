@@ -0,0 +1,109 @@
+#ifndef RATELIMIT_H
+#define RATELIMIT_H
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+
+#include "socket.h"
+namespace Sync{
+
+struct Rate
+{
+    uint32_t burst;      // Tokens the bucket holds when full
+    uint32_t perSecond;  // Tokens added back each second
+};
+
+// Milliseconds on a monotonic clock. Only differences are used, so wrapping
+// after 49 days does no harm.
+uint32_t NowMilliseconds(void);
+
+// Token bucket packed into one atomic word: the time of the last refill in the
+// high half, milli-tokens in the low half. Take() is a single CAS loop, so any
+// number of threads can share a bucket without a lock. A zeroed bucket is full.
+class TokenBucket
+{
+private:
+    std::atomic<uint64_t> state;
+public:
+    TokenBucket(void) : state(0) {;}
+    bool Take(uint32_t now, Rate const & rate);
+    void Reset(void) {state.store(0, std::memory_order_relaxed);}
+};
+
+class SourceLimiter;
+
+// Proof that a connection was admitted. Holds its place in the per-source and
+// total connection counts until it is destroyed.
+class Admission
+{
+    friend class SourceLimiter;
+private:
+    SourceLimiter & limiter;
+    void * slot;  // Per-source entry, null for local or untracked peers
+    Admission(SourceLimiter & limiter, void * slot);
+    Admission(Admission const &);
+    Admission & operator=(Admission const &);
+public:
+    ~Admission(void);
+    // Charges one message to the peer's source address.
+    bool TakeMessage(void);
+};
+
+// Per source address limits, kept in a fixed size, sharded, open addressing
+// table with atomic slots. Admitting a connection or charging a message is a
+// few atomic operations with no lock, so a flood from one address cannot
+// stall anyone else. IPv6 peers are grouped by /64, the usual allocation to a
+// single host, except IPv4-mapped ones, which count as their IPv4 address.
+// Unix socket peers are only subject to the total cap.
+class SourceLimiter
+{
+    friend class Admission;
+public:
+    struct Limits
+    {
+        Rate connects;             // New connections per source
+        Rate messages;             // Messages per source, across its connections
+        int maxPerSource;          // Concurrent connections per source
+        int maxTotal;              // Concurrent connections overall
+    };
+
+private:
+    struct Slot
+    {
+        std::atomic<uint64_t> key;  // 0 while free
+        std::atomic<int> connections;
+        std::atomic<uint32_t> lastSeen;
+        TokenBucket connects;
+        TokenBucket messages;
+    };
+    struct alignas(64) Shard
+    {
+        std::unique_ptr<Slot[]> slots;
+    };
+
+    static const int ShardCount = 16;
+    static const int MaxProbe = 16;
+    static const uint32_t IdleMilliseconds = 60000;  // Before a free slot may be taken over
+
+    Limits limits;
+    Shard shards[ShardCount];
+    size_t slotsPerShard;  // Power of two
+    std::atomic<int> total;
+    std::atomic<uint64_t> rejected;
+
+    Slot * Find(uint64_t key, uint32_t now);
+    void Release(Slot * slot);
+
+public:
+    SourceLimiter(Limits const & limits, size_t slotsPerShard = 4096);
+    // Returns null if the peer is over a limit and should be dropped unread.
+    std::shared_ptr<Admission> Admit(Endpoint const & peer);
+    Limits const & GetLimits(void) const {return limits;}
+    // Only meant for start-up; connections already admitted are not revisited.
+    void SetMaxTotal(int count) {limits.maxTotal = count;}
+    void SetMaxPerSource(int count) {limits.maxPerSource = count;}
+    int Connections(void) const {return total.load(std::memory_order_relaxed);}
+    uint64_t Rejected(void) const {return rejected.load(std::memory_order_relaxed);}
+};
+};
+#endif // RATELIMIT_H
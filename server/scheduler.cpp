@@ -0,0 +1,130 @@
+#include "scheduler.h"
+#include <exception>
+#include <string>
+
+#include "log.h"
+
+namespace Sync{
+
+Scheduler::Scheduler(size_t count)
+    : nextSequence(0), targetWorkers(0), queued(0), liveWorkers(0), stopping(false)
+{
+    Resize(count);
+}
+
+Scheduler::~Scheduler(void)
+{
+    Shutdown();
+}
+
+void Scheduler::Post(Task task)
+{
+    PostAfter(std::chrono::milliseconds(0), std::move(task));
+}
+
+void Scheduler::PostAfter(std::chrono::milliseconds delay, Task task)
+{
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        if (stopping)
+            return;
+        tasks.push(Timed{Clock::now() + delay, nextSequence++, std::move(task)});
+        queued.store(tasks.size(), std::memory_order_relaxed);
+    }
+    wakeup.notify_one();
+}
+
+void Scheduler::Resize(size_t count)
+{
+    if (count == 0)
+        count = 1;
+    std::vector<std::thread> finished;
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        if (stopping)
+            return;
+        // Reap the workers an earlier shrink retired
+        for (auto& id : retired)
+        {
+            for (size_t i=0;i<workers.size();i++)
+            {
+                if (workers[i].get_id() == id)
+                {
+                    finished.push_back(std::move(workers[i]));
+                    workers[i] = std::move(workers.back());
+                    workers.pop_back();
+                    break;
+                }
+            }
+        }
+        retired.clear();
+        targetWorkers = count;
+        while (liveWorkers < targetWorkers)
+        {
+            workers.emplace_back(&Scheduler::WorkerMain, this);
+            liveWorkers++;
+        }
+    }
+    // Shrinking: idle workers notice the lower target and exit.
+    wakeup.notify_all();
+    // They have left their loop already, so these joins do not wait on tasks
+    for (auto& worker : finished)
+        worker.join();
+}
+
+void Scheduler::WorkerMain(void)
+{
+    std::unique_lock<std::mutex> lock(queueMutex);
+    while (true)
+    {
+        if (stopping || liveWorkers > targetWorkers)
+            break;
+        if (tasks.empty())
+        {
+            wakeup.wait(lock);
+            continue;
+        }
+        if (tasks.top().due > Clock::now())
+        {
+            wakeup.wait_until(lock, tasks.top().due);
+            continue;
+        }
+        Task task = std::move(const_cast<Timed&>(tasks.top()).task);
+        tasks.pop();
+        queued.store(tasks.size(), std::memory_order_relaxed);
+        lock.unlock();
+        try
+        {
+            task();
+        }
+        catch (std::string const & error)
+        {
+            Log(LogLevel::Error) << "Scheduled task failed: " << error;
+        }
+        catch (std::exception const & error)
+        {
+            Log(LogLevel::Error) << "Scheduled task failed: " << error.what();
+        }
+        lock.lock();
+    }
+    liveWorkers--;
+    if (!stopping)
+        retired.push_back(std::this_thread::get_id());
+}
+
+void Scheduler::Shutdown(void)
+{
+    std::vector<std::thread> finished;
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        stopping = true;
+        finished.swap(workers);
+    }
+    wakeup.notify_all();
+    for (auto& worker : finished)
+    {
+        if (worker.joinable())
+            worker.join();
+    }
+}
+};
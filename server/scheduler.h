@@ -0,0 +1,64 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+#include <chrono>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace Sync{
+
+// A fixed pool of worker threads running short tasks, optionally after a
+// delay. Work that would otherwise need a thread of its own (a bot waiting to
+// move, a lobby waiting to be filled) becomes a task here instead.
+class Scheduler
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+    typedef std::function<void(void)> Task;
+
+private:
+    struct Timed
+    {
+        Clock::time_point due;
+        unsigned long sequence;  // Keeps tasks due at the same time in FIFO order
+        Task task;
+        bool operator>(Timed const & other) const
+        {
+            return due != other.due ? due > other.due : sequence > other.sequence;
+        }
+    };
+
+    std::mutex queueMutex;
+    std::condition_variable wakeup;
+    std::priority_queue<Timed, std::vector<Timed>, std::greater<Timed>> tasks;
+    std::vector<std::thread> workers;
+    std::vector<std::thread::id> retired;  // Workers that left after a shrink, not joined yet
+    unsigned long nextSequence;
+    std::atomic<size_t> targetWorkers;  // Atomic so the counts can be read without queueMutex
+    std::atomic<size_t> queued;
+    size_t liveWorkers;
+    bool stopping;
+
+    void WorkerMain(void);
+    Scheduler(Scheduler const &);
+    Scheduler & operator=(Scheduler const &);
+
+public:
+    Scheduler(size_t workers);
+    ~Scheduler(void);
+    void Post(Task task);
+    void PostAfter(std::chrono::milliseconds delay, Task task);
+    // Grows or shrinks the pool; surplus workers exit after their current task
+    // and are joined by a later Resize or Shutdown.
+    void Resize(size_t workers);
+    size_t WorkerCount(void) const {return targetWorkers.load(std::memory_order_relaxed);}
+    size_t Pending(void) const {return queued.load(std::memory_order_relaxed);}
+    // Stops the workers. Tasks that have not started yet are dropped.
+    void Shutdown(void);
+};
+};
+#endif // SCHEDULER_H
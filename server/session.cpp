@@ -0,0 +1,122 @@
+#include "session.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <openssl/rand.h>
+
+SessionTable::SessionTable(std::chrono::milliseconds g)
+    : grace(g)
+{
+    ;
+}
+
+SessionTable::Entry * SessionTable::Find(SessionToken const & token)
+{
+    if (token.index >= entries.size() || entries[token.index].tag != token.tag || token.tag == 0)
+        return nullptr;
+    return &entries[token.index];
+}
+
+void SessionTable::Free(uint32_t index)
+{
+    freeSlots.push_back(index);
+    entries[index].tag = 0;
+}
+
+SessionToken SessionTable::Issue(int lobbyId)
+{
+    // Drawn before taking the lock, the CSPRNG may have to reseed
+    uint64_t tag = 0;
+    while (tag == 0)
+    {
+        if (RAND_bytes((unsigned char *)&tag, sizeof(tag)) != 1)
+            throw std::string("Unable to draw a session tag");
+    }
+
+    std::lock_guard<std::mutex> lock(tableMutex);
+    uint32_t index;
+    if (!freeSlots.empty())
+    {
+        index = freeSlots.back();
+        freeSlots.pop_back();
+    }
+    else
+    {
+        index = entries.size();
+        entries.push_back(Entry());
+    }
+    Entry & entry = entries[index];
+    entry.tag = tag;
+    entry.lobbyId = lobbyId;
+    entry.connected = true;
+    return SessionToken(index, tag);
+}
+
+void SessionTable::Disconnected(SessionToken const & token)
+{
+    std::lock_guard<std::mutex> lock(tableMutex);
+    Entry * entry = Find(token);
+    if (!entry || !entry->connected)
+        return;
+    entry->connected = false;
+    entry->deadline = Clock::now() + grace;
+    graceQueue.push_back(Pending{token, entry->deadline});
+}
+
+bool SessionTable::Resume(SessionToken const & token, int & lobbyId)
+{
+    std::lock_guard<std::mutex> lock(tableMutex);
+    Entry * entry = Find(token);
+    if (!entry || (!entry->connected && Clock::now() > entry->deadline))
+        return false;
+    entry->connected = true;
+    lobbyId = entry->lobbyId;
+    return true;
+}
+
+void SessionTable::Revoke(SessionToken const & token)
+{
+    std::lock_guard<std::mutex> lock(tableMutex);
+    if (Find(token))
+        Free(token.index);
+}
+
+std::vector<SessionTable::Expired> SessionTable::Expire(void)
+{
+    std::vector<Expired> expired;
+    std::lock_guard<std::mutex> lock(tableMutex);
+    Clock::time_point now = Clock::now();
+    while (!graceQueue.empty() && graceQueue.front().deadline <= now)
+    {
+        Pending pending = graceQueue.front();
+        graceQueue.pop_front();
+        // Skip sessions that resumed, were revoked, or dropped again later.
+        Entry * entry = Find(pending.token);
+        if (!entry || entry->connected || entry->deadline != pending.deadline)
+            continue;
+        expired.push_back(Expired{pending.token, entry->lobbyId});
+        Free(pending.token.index);
+    }
+    return expired;
+}
+
+size_t SessionTable::Count(void)
+{
+    std::lock_guard<std::mutex> lock(tableMutex);
+    return entries.size() - freeSlots.size();
+}
+
+std::string SessionTable::Format(SessionToken const & token)
+{
+    char text[25];
+    snprintf(text, sizeof(text), "%08x%016llx", (unsigned)token.index, (unsigned long long)token.tag);
+    return text;
+}
+
+bool SessionTable::Parse(std::string const & text, SessionToken & token)
+{
+    if (text.size() != 24 || text.find_first_not_of("0123456789abcdefABCDEF") != std::string::npos)
+        return false;
+    token.index = (uint32_t)strtoul(text.substr(0, 8).c_str(), nullptr, 16);
+    token.tag = strtoull(text.substr(8).c_str(), nullptr, 16);
+    return true;
+}
@@ -0,0 +1,80 @@
+#ifndef SESSION_H
+#define SESSION_H
+#include <stdint.h>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Sessions let a player whose connection dropped reattach to their lobby slot.
+// A token is issued when the player joins a lobby. When the connection is lost
+// the session enters a grace window; "resume <token>" within that window puts a
+// new connection back into the same slot.
+//
+// A token is the slot index in the table plus a 64 bit tag from the system
+// CSPRNG. The index makes lookup a bounds check and one compare, no hashing;
+// only the tag is secret, and it doubles as the lobby engine's session id.
+struct SessionToken
+{
+    uint32_t index;
+    uint64_t tag;       // Never 0 for an issued token
+    SessionToken(void) : index(0), tag(0) {;}
+    SessionToken(uint32_t i, uint64_t t) : index(i), tag(t) {;}
+};
+
+class SessionTable
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Expired
+    {
+        SessionToken token;
+        int lobbyId;
+    };
+
+private:
+    struct Entry
+    {
+        uint64_t tag;       // 0 when the slot is free
+        int lobbyId;
+        bool connected;
+        Clock::time_point deadline;
+    };
+    struct Pending
+    {
+        SessionToken token;
+        Clock::time_point deadline;
+    };
+
+    std::mutex tableMutex;
+    std::vector<Entry> entries;
+    std::vector<uint32_t> freeSlots;
+    std::deque<Pending> graceQueue;  // Ordered by deadline, the grace is fixed
+    std::chrono::milliseconds grace;
+
+    Entry * Find(SessionToken const & token);
+    void Free(uint32_t index);
+
+public:
+    SessionTable(std::chrono::milliseconds grace);
+
+    SessionToken Issue(int lobbyId);
+    // The connection behind the session dropped; start its grace window.
+    void Disconnected(SessionToken const & token);
+    // Succeeds for a live session, whose connection the caller replaces, or a
+    // disconnected one still within its grace window, and hands back the lobby
+    // it belongs to.
+    bool Resume(SessionToken const & token, int & lobbyId);
+    void Revoke(SessionToken const & token);
+    // Frees and returns every session whose grace window has run out.
+    std::vector<Expired> Expire(void);
+    size_t Count(void);
+
+    // 24 hex digits: the index, then the tag.
+    static std::string Format(SessionToken const & token);
+    static bool Parse(std::string const & text, SessionToken & token);
+};
+
+#endif // SESSION_H
@@ -2,26 +2,126 @@
 #include <unistd.h>
 #include <iostream>
 #include <errno.h>
+#include <stddef.h>
 
 #include "socket.h"
 namespace Sync{
 	
+Endpoint::Endpoint(void)
+    : length(0), type(SOCK_STREAM)
+{
+    bzero((char*)&address,sizeof(address));
+}
+
+Endpoint Endpoint::Inet(std::string const & ipAddress, unsigned int port)
+{
+    Endpoint endpoint;
+    sockaddr_in * v4 = (sockaddr_in*)&endpoint.address;
+    sockaddr_in6 * v6 = (sockaddr_in6*)&endpoint.address;
+    if (inet_pton(AF_INET,ipAddress.c_str(),&v4->sin_addr) == 1)
+    {
+        v4->sin_family = AF_INET;
+        v4->sin_port = htons(port);
+        endpoint.length = sizeof(sockaddr_in);
+    }
+    else if (inet_pton(AF_INET6,ipAddress.c_str(),&v6->sin6_addr) == 1)
+    {
+        v6->sin6_family = AF_INET6;
+        v6->sin6_port = htons(port);
+        endpoint.length = sizeof(sockaddr_in6);
+    }
+    else
+        throw std::string("IP Address provided is invalid");
+    return endpoint;
+}
+
+Endpoint Endpoint::Unix(std::string const & path, int type)
+{
+    Endpoint endpoint;
+    sockaddr_un * local = (sockaddr_un*)&endpoint.address;
+    if (path.empty() || path.size() >= sizeof(local->sun_path))
+        throw std::string("Unix socket path is empty or too long");
+    local->sun_family = AF_UNIX;
+    path.copy(local->sun_path, path.size());
+    if (path[0] == '@')
+        local->sun_path[0] = '\0';
+    endpoint.length = offsetof(sockaddr_un, sun_path) + path.size() + (path[0] == '@' ? 0 : 1);
+    endpoint.type = type;
+    return endpoint;
+}
+
+Endpoint Endpoint::Parse(std::string const & text)
+{
+    static const std::string unixPrefix = "unix:";
+    static const std::string seqpacketPrefix = "seqpacket:";
+    if (text.compare(0, unixPrefix.size(), unixPrefix) == 0)
+        return Unix(text.substr(unixPrefix.size()), SOCK_STREAM);
+    if (text.compare(0, seqpacketPrefix.size(), seqpacketPrefix) == 0)
+        return Unix(text.substr(seqpacketPrefix.size()), SOCK_SEQPACKET);
+
+    std::string host = "0.0.0.0";
+    std::string port = text;
+    size_t colon = text.rfind(':');
+    if (colon != std::string::npos)
+    {
+        host = text.substr(0, colon);
+        port = text.substr(colon + 1);
+        if (host.size() >= 2 && host.front() == '[' && host.back() == ']')
+            host = host.substr(1, host.size() - 2);
+    }
+    try {
+        return Inet(host, std::stoi(port));
+    } catch (const std::exception &) {
+        throw std::string("Invalid endpoint: ") + text;
+    }
+}
+
+std::string Endpoint::Path(void) const
+{
+    sockaddr_un const * local = (sockaddr_un const*)&address;
+    if (Family() != AF_UNIX || local->sun_path[0] == '\0')
+        return "";
+    return local->sun_path;
+}
+
+std::string Endpoint::ToString(void) const
+{
+    char text[INET6_ADDRSTRLEN];
+    if (Family() == AF_INET)
+    {
+        sockaddr_in const * v4 = (sockaddr_in const*)&address;
+        inet_ntop(AF_INET, &v4->sin_addr, text, sizeof(text));
+        return std::string(text) + ":" + std::to_string(ntohs(v4->sin_port));
+    }
+    if (Family() == AF_INET6)
+    {
+        sockaddr_in6 const * v6 = (sockaddr_in6 const*)&address;
+        inet_ntop(AF_INET6, &v6->sin6_addr, text, sizeof(text));
+        return "[" + std::string(text) + "]:" + std::to_string(ntohs(v6->sin6_port));
+    }
+    sockaddr_un const * local = (sockaddr_un const*)&address;
+    // Clients that never bind come back from accept() with no name at all
+    if (length <= offsetof(sockaddr_un, sun_path))
+        return type == SOCK_SEQPACKET ? "seqpacket:" : "unix:";
+    std::string name = local->sun_path[0] == '\0'
+        ? "@" + std::string(local->sun_path + 1, length - offsetof(sockaddr_un, sun_path) - 1)
+        : std::string(local->sun_path);
+    return (type == SOCK_SEQPACKET ? "seqpacket:" : "unix:") + name;
+}
+
 Socket::Socket(std::string const & ipAddress, unsigned int port)
-    : Blockable(),open(false)
+    : Socket(Endpoint::Inet(ipAddress, port))
+{
+    ;
+}
+
+Socket::Socket(Endpoint const & endpoint)
+    : Blockable(),socketDescriptor(endpoint),open(false)
 {
     // First, call socket() to get a socket file descriptor
-    SetFD(socket(AF_INET, SOCK_STREAM, 0));
+    SetFD(socket(endpoint.Family(), endpoint.type, 0));
     if (GetFD() < 0)
         throw std::string("Unable to initialize socket server");
-
-    // Start by zeroing out the socket descriptor
-     bzero((char*)&socketDescriptor,sizeof(sockaddr_in));
-
-    // Now try to map the IP address, as provided, into the socket Descriptor
-    if (!inet_aton(ipAddress.c_str(),&socketDescriptor.sin_addr))
-        throw std::string("IP Address provided is invalid");
-    socketDescriptor.sin_family = AF_INET;
-    socketDescriptor.sin_port = htons(port);
 }
 
 Socket::Socket(int sFD)
@@ -30,18 +130,33 @@ Socket::Socket(int sFD)
     open = true;
 }
 
-Socket::Socket(Socket const & s)
-    :Blockable(s)
-{    
-    open = s.open;
+Socket::Socket(int sFD, Endpoint const & peer)
+    : Blockable(sFD), socketDescriptor(peer)
+{
+    open = true;
 }
 
-Socket & Socket::operator=(Socket const & rhs)
+Socket::Socket(Socket && s) noexcept
+    : Blockable(std::move(s)), socketDescriptor(s.socketDescriptor), open(s.open.load()),
+      terminator(std::move(s.terminator)), tls(std::move(s.tls))
 {
-    close(GetFD());
-    socketDescriptor = rhs.socketDescriptor;
-    SetFD(dup(rhs.GetFD()));
-    open = rhs.open;
+    s.open = false;
+}
+
+Socket & Socket::operator=(Socket && rhs) noexcept
+{
+    if (this != &rhs)
+    {
+        Close();
+        SetFD(rhs.GetFD());
+        rhs.SetFD(-1);
+        socketDescriptor = rhs.socketDescriptor;
+        open = rhs.open.load();
+        rhs.open = false;
+        terminator = std::move(rhs.terminator);
+        tls = std::move(rhs.tls);
+    }
+    return *this;
 }
 
 Socket::~Socket(void)
@@ -52,22 +167,27 @@ Socket::~Socket(void)
 
 int Socket::Open(void)
 {
-    int connectReturn = connect(GetFD(),(sockaddr*)&socketDescriptor,sizeof(socketDescriptor));
+    int connectReturn = connect(GetFD(),(sockaddr*)&socketDescriptor.address,socketDescriptor.length);
     if (connectReturn != 0)
     {
         throw std::string("Unable to open connection");
     }
     open = true;
+    return 0;
 }
 
 int Socket::Write(ByteArray const & buffer)
 {
     if (!open)
         return -1;
-    char * raw = new char[buffer.v.size()];
-    for (int i=0;i<buffer.v.size();i++)
-        raw[i] = buffer.v[i];
-    int returnValue = write(GetFD(),raw,buffer.v.size());
+    // Send straight out of the caller's buffer so that a shared broadcast
+    // buffer is never copied per recipient. A peer that went away must not
+    // take the whole server down with SIGPIPE.
+    int returnValue;
+    if (tls)
+        returnValue = tls->Write(buffer.v.data(),buffer.v.size());
+    else
+        returnValue = send(GetFD(),buffer.v.data(),buffer.v.size(),MSG_NOSIGNAL);
     if (returnValue <=0)
         open = false;
     return returnValue;
@@ -81,32 +201,79 @@ int Socket::Read(ByteArray & buffer)
         return 0;
 
     buffer.v.clear();
-    // Allow interruption of block.
-    FlexWait waiter(2,this,&terminator);
-    Blockable * result = waiter.Wait();
-    // This happens if the call was shutdown on this side
-    if (result == &terminator)
+    ssize_t received;
+    do
     {
-        terminator.Reset();
-        return 0;
-    }
-    // If we got here, we need to read the socket
-    // Messages greater than MAX_BUFFER_SIZE are not handled gracefully.
-    ssize_t received = recv(GetFD(), raw, MAX_BUFFER_SIZE, 0);
-    for (int i=0;i<received;i++)
-        buffer.v.push_back(raw[i]);
-    
+        // Records TLS already decrypted will not make the socket readable
+        // again, while a readable socket may hold only part of a record.
+        if (!tls || !tls->Pending())
+        {
+            // Allow interruption of block.
+            FlexWait waiter(2,this,&terminator);
+            Blockable * result = waiter.Wait();
+            // This happens if the call was shutdown on this side
+            if (result == &terminator)
+            {
+                terminator.Reset();
+                return 0;
+            }
+        }
+        // If we got here, we need to read the socket
+        // Streams hand back at most MAX_BUFFER_SIZE bytes and the caller
+        // reassembles; a SOCK_SEQPACKET record has to come out whole in one read,
+        // so its length is peeked first rather than cutting it at the buffer.
+        if (tls)
+            received = tls->Read(raw, MAX_BUFFER_SIZE);
+        else if (socketDescriptor.type == SOCK_SEQPACKET)
+        {
+            received = recv(GetFD(), nullptr, 0, MSG_PEEK | MSG_TRUNC);
+            if (received > 0)
+            {
+                buffer.v.resize(received);
+                received = recv(GetFD(), buffer.v.data(), buffer.v.size(), 0);
+            }
+            if (received <= 0)
+            {
+                buffer.v.clear();
+                open = false;
+            }
+            return received;
+        }
+        else
+            received = recv(GetFD(), raw, MAX_BUFFER_SIZE, 0);
+    } while (received == TlsSession::WouldBlock);
+    if (received > 0)
+        buffer.v.assign(raw, raw + received);
+
     if (received <=0)
         open = false;
     return received;
 }
 
-void Socket::Close(void)
+void Socket::StartTls(TlsContext & context)
+{
+    tls = context.Accept(GetFD());
+}
+
+void Socket::Interrupt(void)
 {
-    close(GetFD());
-    shutdown(GetFD(),SHUT_RDWR);
+    if (GetFD() >= 0)
+        shutdown(GetFD(),SHUT_RDWR);
     open = false;
     terminator.Trigger();
+}
 
+void Socket::Close(void)
+{
+    // Forget the descriptor so it is never closed twice (by then the number
+    // may belong to someone else's connection).
+    if (GetFD() >= 0)
+    {
+        shutdown(GetFD(),SHUT_RDWR);
+        close(GetFD());
+        SetFD(-1);
+    }
+    open = false;
+    terminator.Trigger();
 }
 };
\ No newline at end of file
@@ -1,14 +1,18 @@
 #ifndef SOCKET_H
 #define SOCKET_H
+#include <atomic>
 #include <vector>
 #include <string>
+#include <memory>
 
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <sys/types.h>
 
 #include "Blockable.h"
+#include "tls.h"
 namespace Sync{
 	
 class ByteArray
@@ -23,36 +27,69 @@ public:
         return returnValue;
     }
     ByteArray(void){}
-    ByteArray(std::string const & in)
-    {
-        for (int i=0;i<in.size();i++)
-            v.push_back(in[i]);
-    }
-    ByteArray(void * p, int s)
-    {
-        char * temp = (char*)p;
-        for (int i=0;i<s;i++)
-            v.push_back(temp[i]);
-    }
+    ByteArray(std::string const & in) : v(in.begin(), in.end()){}
+    ByteArray(void * p, int s) : v((char*)p, (char*)p + s){}
+};
+
+// Where a socket connects or listens: IPv4 or IPv6 TCP, or a local AF_UNIX
+// socket. SOCK_SEQPACKET Unix sockets keep message boundaries in the kernel.
+class Endpoint
+{
+public:
+    sockaddr_storage address;
+    socklen_t length;
+    int type;
+
+    Endpoint(void);
+    // Accepts an IPv4 or IPv6 literal.
+    static Endpoint Inet(std::string const & ipAddress, unsigned int port);
+    // A leading '@' names a socket in the Linux abstract namespace.
+    static Endpoint Unix(std::string const & path, int type = SOCK_STREAM);
+    // "3000", "127.0.0.1:3000", "[::1]:3000", "unix:/path" or "seqpacket:/path"
+    static Endpoint Parse(std::string const & text);
+
+    int Family(void) const {return address.ss_family;}
+    bool IsLocal(void) const {return Family() == AF_UNIX;}
+    // Filesystem path of a Unix socket, empty for abstract and inet endpoints.
+    std::string Path(void) const;
+    std::string ToString(void) const;
 };
 
+// A connected or connecting socket. Sockets own their descriptor and are
+// move-only; code that needs to share one shares the object that holds it.
 class Socket : public Blockable
 {
 private:
-    sockaddr_in socketDescriptor;
-    bool open;
+    Endpoint socketDescriptor;
+    std::atomic<bool> open;  // Cleared by whichever thread sees the connection end
     Event terminator;
+    std::shared_ptr<TlsSession> tls;
 public:
     Socket(std::string const & ipAddress, unsigned int port);
+    Socket(Endpoint const & endpoint);
     Socket(int socketFD);
-    Socket(Socket const & s);
-    Socket & operator=(Socket const & s);
+    Socket(int socketFD, Endpoint const & peer);
+    Socket(Socket && s) noexcept;
+    Socket & operator=(Socket && s) noexcept;
+    Socket(Socket const &) = delete;
+    Socket & operator=(Socket const &) = delete;
     ~Socket(void);
 
     int Open(void);
     int Write(ByteArray const & buffer);
     int Read(ByteArray & buffer);
+    // Only for the thread that owns the socket; releases the descriptor.
     void Close(void);
+    // Safe from any thread: shuts the connection down so a Read or Write
+    // blocked elsewhere returns, but leaves closing the descriptor to the
+    // owner, since its number could otherwise be reused under the reader.
+    void Interrupt(void);
+    // The address connected to, or for accepted sockets the peer's address.
+    Endpoint const & GetEndpoint(void) const {return socketDescriptor;}
+    // Server side TLS handshake; later reads and writes are encrypted.
+    void StartTls(TlsContext & context);
+    bool IsTls(void) const {return tls != nullptr;}
+    bool IsKernelTls(void) const {return tls && tls->KernelSend() && tls->KernelRecv();}
 };
 };
 #endif // SOCKET_H
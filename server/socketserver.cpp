@@ -3,23 +3,31 @@
 #include <iostream>
 #include <errno.h>
 #include <algorithm>
+#include <netinet/tcp.h>
 namespace Sync{
 	
 SocketServer::SocketServer(int port)
+    : SocketServer(Endpoint::Inet("0.0.0.0", port))
+{
+    ;
+}
+
+SocketServer::SocketServer(Endpoint const & endpoint)
+    : socketDescriptor(endpoint)
 {
     // The first call has to be to socket(). This creates a UNIX socket.
-    int socketFD = socket(AF_INET, SOCK_STREAM, 0);
+    int socketFD = socket(endpoint.Family(), endpoint.type, 0);
     if (socketFD < 0)
         throw std::string("Unable to open the socket server");
 
+    // A stale socket file from an earlier run would make bind() fail.
+    if (!endpoint.Path().empty())
+        unlink(endpoint.Path().c_str());
+
     // The second call is to bind().  This identifies the socket file
     // descriptor with the description of the kind of socket we want to have.
-    bzero((char*)&socketDescriptor,sizeof(sockaddr_in));
-    socketDescriptor.sin_family = AF_INET;
-    socketDescriptor.sin_port = htons(port);
-    socketDescriptor.sin_addr.s_addr = INADDR_ANY;
-    if (bind(socketFD,(sockaddr*)&socketDescriptor,sizeof(socketDescriptor)) < 0)
-        throw std::string("Unable to bind socket to requested port");
+    if (bind(socketFD,(sockaddr*)&socketDescriptor.address,socketDescriptor.length) < 0)
+        throw std::string("Unable to bind socket to ") + endpoint.ToString();
 
     // Set up a maximum number of pending connections to accept
     listen(socketFD,5);
@@ -29,6 +37,10 @@ SocketServer::SocketServer(int port)
 SocketServer::~SocketServer(void)
 {
     Shutdown();
+    if (GetFD() >= 0)
+        close(GetFD());
+    if (!socketDescriptor.Path().empty())
+        unlink(socketDescriptor.Path().c_str());
 }
 
 Socket SocketServer::Accept(void)
@@ -44,12 +56,25 @@ Socket SocketServer::Accept(void)
 
     if (result == this)
     {
-        int connectionFD = accept(GetFD(),NULL,0);
+        Endpoint peer;
+        peer.length = sizeof(peer.address);
+        peer.type = socketDescriptor.type;
+        int connectionFD = accept(GetFD(),(sockaddr*)&peer.address,&peer.length);
         if (connectionFD < 0)
         {
+            // Shutdown() from another thread also wakes the wait through the
+            // listener itself, which then is no longer listening.
+            if (errno == EINVAL)
+                throw TerminationException(2);
             throw std::string("Unexpected error in the server");
         }
-        return Socket(connectionFD);
+        // Game messages are tiny request/response exchanges; don't let Nagle hold them back.
+        if (!socketDescriptor.IsLocal())
+        {
+            int enable = 1;
+            setsockopt(connectionFD, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+        }
+        return Socket(connectionFD, peer);
     }
     else
         throw std::string("Unexpected error in the server");
@@ -57,8 +82,11 @@ Socket SocketServer::Accept(void)
 
 void SocketServer::Shutdown(void)
 {
-    close(GetFD());
-    shutdown(GetFD(),SHUT_RDWR);
+    // Usually called from another thread than the one in Accept(), so only
+    // stop listening here; the destructor closes the descriptor once nobody
+    // can be waiting on it.
+    if (GetFD() >= 0)
+        shutdown(GetFD(),SHUT_RDWR);
     terminator.Trigger();
 }
 
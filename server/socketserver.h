@@ -11,12 +11,19 @@ class SocketServer : public Blockable
 private:
     int pipeFD[2];
     Event terminator;
-    sockaddr_in socketDescriptor;
+    Endpoint socketDescriptor;
+    SocketServer(SocketServer const &) = delete;
+    SocketServer & operator=(SocketServer const &) = delete;
 public:
     SocketServer(int port);
+    SocketServer(Endpoint const & endpoint);
     ~SocketServer();
+    // Throws TerminationException once Shutdown() has been called.
     Socket Accept(void);
+    // Safe from any thread; wakes Accept(). The descriptor stays open until
+    // the server is destroyed.
     void Shutdown(void);
+    Endpoint const & GetEndpoint(void) const {return socketDescriptor;}
 };
 };
 #endif // SOCKETSERVER_H
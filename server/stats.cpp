@@ -0,0 +1,86 @@
+#include "stats.h"
+#include <algorithm>
+
+namespace Sync{
+
+LatencyHistogram::LatencyHistogram(void)
+    : count(0), totalMicros(0), maxMicros(0)
+{
+    for (int i=0;i<BucketCount;i++)
+        buckets[i].store(0, std::memory_order_relaxed);
+}
+
+void LatencyHistogram::Record(std::chrono::steady_clock::duration elapsed)
+{
+    uint64_t micros = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+    int bucket = 0;
+    while (bucket < BucketCount - 1 && (1ull << bucket) <= micros)
+        bucket++;
+    buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+    totalMicros.fetch_add(micros, std::memory_order_relaxed);
+    uint64_t seen = maxMicros.load(std::memory_order_relaxed);
+    while (micros > seen && !maxMicros.compare_exchange_weak(seen, micros, std::memory_order_relaxed))
+        ;
+}
+
+uint64_t LatencyHistogram::Percentile(uint64_t total, unsigned percent) const
+{
+    uint64_t wanted = (total * percent + 99) / 100;
+    uint64_t seen = 0;
+    for (int i=0;i<BucketCount;i++)
+    {
+        seen += buckets[i].load(std::memory_order_relaxed);
+        if (seen >= wanted)
+            return 1ull << i;
+    }
+    return 1ull << (BucketCount - 1);
+}
+
+LatencyHistogram::Summary LatencyHistogram::Summarize(void) const
+{
+    // Writers keep going while this runs, so the figures are only as
+    // consistent as the moment allows; fine for a dashboard.
+    Summary summary = {0, 0, 0, 0, 0};
+    summary.count = count.load(std::memory_order_relaxed);
+    if (summary.count == 0)
+        return summary;
+    summary.meanMicros = totalMicros.load(std::memory_order_relaxed) / summary.count;
+    summary.p50Micros = Percentile(summary.count, 50);
+    summary.p99Micros = Percentile(summary.count, 99);
+    summary.maxMicros = maxMicros.load(std::memory_order_relaxed);
+    summary.p50Micros = std::min(summary.p50Micros, summary.maxMicros);
+    summary.p99Micros = std::min(summary.p99Micros, summary.maxMicros);
+    return summary;
+}
+
+void LatencyHistogram::Add(LatencyHistogram const & other)
+{
+    for (int i=0;i<BucketCount;i++)
+        buckets[i].fetch_add(other.buckets[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+    count.fetch_add(other.count.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    totalMicros.fetch_add(other.totalMicros.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    uint64_t micros = other.maxMicros.load(std::memory_order_relaxed);
+    uint64_t seen = maxMicros.load(std::memory_order_relaxed);
+    while (micros > seen && !maxMicros.compare_exchange_weak(seen, micros, std::memory_order_relaxed))
+        ;
+}
+
+void LatencyHistogram::Reset(void)
+{
+    for (int i=0;i<BucketCount;i++)
+        buckets[i].store(0, std::memory_order_relaxed);
+    count.store(0, std::memory_order_relaxed);
+    totalMicros.store(0, std::memory_order_relaxed);
+    maxMicros.store(0, std::memory_order_relaxed);
+}
+
+std::string FormatSummary(LatencyHistogram::Summary const & summary)
+{
+    return "count " + std::to_string(summary.count) +
+        " mean " + std::to_string(summary.meanMicros) + "us" +
+        " p50 " + std::to_string(summary.p50Micros) + "us" +
+        " p99 " + std::to_string(summary.p99Micros) + "us" +
+        " max " + std::to_string(summary.maxMicros) + "us";
+}
+};
@@ -0,0 +1,49 @@
+#ifndef STATS_H
+#define STATS_H
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+
+namespace Sync{
+
+// Counts durations into power of two microsecond buckets. Recording is a few
+// relaxed atomic adds, so it can sit on hot paths, and reading a summary never
+// blocks a writer. Percentiles are reported as the upper bound of their bucket.
+class LatencyHistogram
+{
+public:
+    static const int BucketCount = 32;  // The last bucket holds everything over ~35 minutes
+
+    struct Summary
+    {
+        uint64_t count;
+        uint64_t meanMicros;
+        uint64_t p50Micros;
+        uint64_t p99Micros;
+        uint64_t maxMicros;
+    };
+
+private:
+    std::atomic<uint64_t> buckets[BucketCount];
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> totalMicros;
+    std::atomic<uint64_t> maxMicros;
+
+    uint64_t Percentile(uint64_t total, unsigned percent) const;
+    LatencyHistogram(LatencyHistogram const &);
+    LatencyHistogram & operator=(LatencyHistogram const &);
+
+public:
+    LatencyHistogram(void);
+    void Record(std::chrono::steady_clock::duration elapsed);
+    Summary Summarize(void) const;
+    // Folds another histogram's counts into this one, e.g. to merge shards.
+    void Add(LatencyHistogram const & other);
+    void Reset(void);
+};
+
+// "count 12 mean 40us p50 64us p99 512us max 300us"
+std::string FormatSummary(LatencyHistogram::Summary const & summary);
+};
+#endif // STATS_H
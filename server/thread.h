@@ -20,8 +20,8 @@ protected:
     Sync::Event terminationEvent;
 
 private:
-    Thread(Thread const &){}
-    Thread & operator=(Thread const &){}
+    Thread(Thread const &) = delete;
+    Thread & operator=(Thread const &) = delete;
 public:
     Thread(int exitTimeout = 1000);
     virtual ~Thread();
@@ -0,0 +1,200 @@
+#include "tls.h"
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <linux/tls.h>
+#include <cerrno>
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+#include <iostream>
+
+namespace Sync{
+
+static std::string LastError(void)
+{
+    char text[256];
+    ERR_error_string_n(ERR_get_error(), text, sizeof(text));
+    return text;
+}
+
+TlsSession::TlsSession(SSL * s, int f)
+    : ssl(s), fd(f), kernelSend(false), kernelRecv(false)
+{
+#ifndef OPENSSL_NO_KTLS
+    kernelSend = BIO_get_ktls_send(SSL_get_wbio(ssl));
+    kernelRecv = BIO_get_ktls_recv(SSL_get_rbio(ssl));
+#endif
+    if (!kernelRecv)
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+TlsSession::~TlsSession(void)
+{
+    SSL_free(ssl);
+}
+
+// TLS record content types and the one handshake message a client may send
+// once the handshake is done (RFC 8446 sections 5.1 and 4.6.3).
+static const unsigned char RecordAlert = 21;
+static const unsigned char RecordHandshake = 22;
+static const unsigned char HandshakeKeyUpdate = 24;
+
+int TlsSession::KernelRead(char * data, int size)
+{
+    // The kernel decrypts every record but reports anything other than
+    // application data through a control message, and fails the call with
+    // EIO if there is no room for one.
+    while (true)
+    {
+        char control[CMSG_SPACE(sizeof(unsigned char))];
+        iovec io = {data, (size_t)size};
+        msghdr message = {};
+        message.msg_iov = &io;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+        ssize_t received = recvmsg(fd, &message, 0);
+        if (received < 0 && errno == EAGAIN)
+            return WouldBlock;
+        if (received <= 0)
+            return received;
+        cmsghdr * header = CMSG_FIRSTHDR(&message);
+        if (!header || header->cmsg_level != SOL_TLS || header->cmsg_type != TLS_GET_RECORD_TYPE)
+            return received;
+        unsigned char type = *CMSG_DATA(header);
+        // close_notify or a fatal alert, the peer is done either way
+        if (type == RecordAlert)
+            return 0;
+        if (type != RecordHandshake)
+            return received;
+        // The kernel holds the receive key and OpenSSL cannot hand it the
+        // next one, so a KeyUpdate ends the connection. Anything else
+        // post-handshake needs no answer from a server.
+        if ((unsigned char)data[0] == HandshakeKeyUpdate)
+            return -1;
+    }
+}
+
+// The socket may be non-blocking, so a send can stop short or not start.
+int TlsSession::KernelWrite(char const * data, int size)
+{
+    int total = 0;
+    while (total < size)
+    {
+        ssize_t sent = send(fd, data + total, size - total, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EAGAIN)
+            sent = Await(SSL_ERROR_WANT_WRITE);
+        if (sent < 0)
+            return -1;
+        total += sent;
+    }
+    return total;
+}
+
+// Waits, without the lock, for the socket to do what OpenSSL asked for.
+// Returns 0 to retry, or -1 if the connection went away meanwhile. Another
+// thread may take the bytes a WANT_READ is after, so that wait is bounded.
+int TlsSession::Await(int sslError)
+{
+    pollfd entry = {fd, (short)(sslError == SSL_ERROR_WANT_READ ? POLLIN : POLLOUT), 0};
+    if (poll(&entry, 1, sslError == SSL_ERROR_WANT_READ ? 50 : -1) < 0 && errno != EINTR)
+        return -1;
+    return (entry.revents & (POLLERR | POLLNVAL)) ? -1 : 0;
+}
+
+int TlsSession::Read(char * data, int size)
+{
+    if (kernelRecv)
+        return KernelRead(data, size);
+    while (true)
+    {
+        int error;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            int received = SSL_read(ssl, data, size);
+            if (received > 0)
+                return received;
+            error = SSL_get_error(ssl, received);
+        }
+        if (error == SSL_ERROR_ZERO_RETURN)
+            return 0;
+        if (error == SSL_ERROR_WANT_READ)
+            return WouldBlock;
+        // The read has a reply of its own to send first.
+        if (error != SSL_ERROR_WANT_WRITE || Await(error) < 0)
+            return -1;
+    }
+}
+
+int TlsSession::Write(char const * data, int size)
+{
+    if (kernelSend)
+        return KernelWrite(data, size);
+    // Retries pass the same buffer, as OpenSSL requires.
+    while (true)
+    {
+        int error;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            int sent = SSL_write(ssl, data, size);
+            if (sent > 0)
+                return sent;
+            error = SSL_get_error(ssl, sent);
+        }
+        if ((error != SSL_ERROR_WANT_READ && error != SSL_ERROR_WANT_WRITE) || Await(error) < 0)
+            return -1;
+    }
+}
+
+bool TlsSession::Pending(void) const
+{
+    if (kernelRecv)
+        return false;
+    std::lock_guard<std::mutex> lock(mutex);
+    return SSL_pending(ssl) > 0;
+}
+
+TlsContext::TlsContext(std::string const & certificateFile, std::string const & keyFile)
+{
+    context = SSL_CTX_new(TLS_server_method());
+    if (!context)
+        throw std::string("Unable to create TLS context: ") + LastError();
+
+    SSL_CTX_set_min_proto_version(context, TLS1_2_VERSION);
+#ifdef SSL_OP_ENABLE_KTLS
+    SSL_CTX_set_options(context, SSL_OP_ENABLE_KTLS);
+#endif
+    // No resumption tickets: they would be written after the handshake, once
+    // the kernel may already own the send side.
+    SSL_CTX_set_num_tickets(context, 0);
+
+    if (SSL_CTX_use_certificate_chain_file(context, certificateFile.c_str()) != 1 ||
+        SSL_CTX_use_PrivateKey_file(context, keyFile.c_str(), SSL_FILETYPE_PEM) != 1 ||
+        SSL_CTX_check_private_key(context) != 1)
+    {
+        std::string error = LastError();
+        SSL_CTX_free(context);
+        throw std::string("Unable to load TLS certificate or key: ") + error;
+    }
+}
+
+TlsContext::~TlsContext(void)
+{
+    SSL_CTX_free(context);
+}
+
+std::shared_ptr<TlsSession> TlsContext::Accept(int fd)
+{
+    SSL * ssl = SSL_new(context);
+    if (!ssl)
+        throw std::string("Unable to create TLS session: ") + LastError();
+    SSL_set_fd(ssl, fd);
+    if (SSL_accept(ssl) != 1)
+    {
+        std::string error = LastError();
+        SSL_free(ssl);
+        throw std::string("TLS handshake failed: ") + error;
+    }
+    return std::make_shared<TlsSession>(ssl, fd);
+}
+};
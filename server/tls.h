@@ -0,0 +1,57 @@
+#ifndef TLS_H
+#define TLS_H
+#include <memory>
+#include <mutex>
+#include <string>
+
+typedef struct ssl_ctx_st SSL_CTX;
+typedef struct ssl_st SSL;
+
+namespace Sync{
+
+// One TLS connection after a successful handshake. When the kernel supports
+// it (kTLS), OpenSSL hands the record keys to the socket and Read/Write go
+// straight to recvmsg()/send(); otherwise they fall back to SSL_read/SSL_write.
+// An SSL object is not safe to use from two threads at once, so the fallback
+// serialises every call on it and puts the socket in non-blocking mode: a
+// reader waiting for the rest of a record never holds the lock a writer needs.
+class TlsSession
+{
+private:
+    SSL * ssl;
+    int fd;
+    bool kernelSend;
+    bool kernelRecv;
+    mutable std::mutex mutex;
+    int KernelRead(char * data, int size);
+    int KernelWrite(char const * data, int size);
+    int Await(int sslError);
+public:
+    // Read has no whole record to hand back yet; wait for the socket again.
+    static const int WouldBlock = -2;
+
+    TlsSession(SSL * ssl, int fd);
+    ~TlsSession(void);
+    int Read(char * data, int size);
+    int Write(char const * data, int size);
+    // True if decrypted bytes are buffered in user space, so the socket
+    // itself may not become readable again.
+    bool Pending(void) const;
+    bool KernelSend(void) const {return kernelSend;}
+    bool KernelRecv(void) const {return kernelRecv;}
+};
+
+class TlsContext
+{
+private:
+    SSL_CTX * context;
+    TlsContext(TlsContext const &);
+    TlsContext & operator=(TlsContext const &);
+public:
+    TlsContext(std::string const & certificateFile, std::string const & keyFile);
+    ~TlsContext(void);
+    // Runs the server side of the handshake on an accepted connection.
+    std::shared_ptr<TlsSession> Accept(int fd);
+};
+};
+#endif // TLS_H
@@ -0,0 +1,146 @@
+#include "trace.h"
+#include <string.h>
+
+using namespace Protocol;
+
+static const char TraceMagic[8] = {'R','P','S','T','R','A','C','E'};
+static const size_t FlushThreshold = 64 * 1024;
+
+void EncodeEvent(std::vector<char> & out, LobbyEvent const & event)
+{
+    out.push_back((char)event.type);
+    PutVarint(out, (uint64_t)event.lobbyId);
+    switch (event.type)
+    {
+    case LobbyEvent::Join:
+    case LobbyEvent::Resume:
+        PutVarint(out, event.session);
+        break;
+    case LobbyEvent::Choose:
+        out.push_back((char)event.playerId);
+        out.push_back((char)event.move);
+        break;
+    case LobbyEvent::Leave:
+    case LobbyEvent::Disconnect:
+        out.push_back((char)event.playerId);
+        break;
+    case LobbyEvent::Resolve:
+        break;
+    }
+}
+
+TraceRecorder::TraceRecorder(std::string const & path)
+    : recorded(0)
+{
+    file = fopen(path.c_str(), "wb");
+    if (!file)
+        throw std::string("Unable to open trace file ") + path;
+    buffer.insert(buffer.end(), TraceMagic, TraceMagic + sizeof(TraceMagic));
+    buffer.push_back((char)TraceVersion);
+}
+
+TraceRecorder::~TraceRecorder(void)
+{
+    Flush();
+    fclose(file);
+}
+
+void TraceRecorder::WriteBuffer(void)
+{
+    if (!buffer.empty())
+        fwrite(buffer.data(), 1, buffer.size(), file);
+    buffer.clear();
+}
+
+void TraceRecorder::Record(LobbyEvent const & event)
+{
+    std::lock_guard<std::mutex> lock(recorderMutex);
+    EncodeEvent(buffer, event);
+    recorded++;
+    if (buffer.size() >= FlushThreshold)
+        WriteBuffer();
+}
+
+void TraceRecorder::Flush(void)
+{
+    std::lock_guard<std::mutex> lock(recorderMutex);
+    WriteBuffer();
+    fflush(file);
+}
+
+size_t TraceRecorder::Recorded(void)
+{
+    std::lock_guard<std::mutex> lock(recorderMutex);
+    return recorded;
+}
+
+TraceReader::TraceReader(std::string const & path)
+    : position(0)
+{
+    FILE * file = fopen(path.c_str(), "rb");
+    if (!file)
+        throw std::string("Unable to open trace file ") + path;
+    char chunk[64 * 1024];
+    size_t got;
+    while ((got = fread(chunk, 1, sizeof(chunk), file)) > 0)
+        data.insert(data.end(), chunk, chunk + got);
+    fclose(file);
+
+    if (data.size() < sizeof(TraceMagic) + 1 || memcmp(data.data(), TraceMagic, sizeof(TraceMagic)) != 0)
+        throw std::string("Not a lobby trace: ") + path;
+    if ((uint8_t)data[sizeof(TraceMagic)] != TraceVersion)
+        throw std::string("Unsupported trace version in ") + path;
+    position = sizeof(TraceMagic) + 1;
+}
+
+bool TraceReader::Next(LobbyEvent & event)
+{
+    if (position >= data.size())
+        return false;
+
+    char const * p = data.data() + position;
+    size_t left = data.size() - position;
+    uint64_t value = 0;
+    size_t used = 0;
+
+    event = LobbyEvent();
+    event.type = (LobbyEvent::Type)p[0];
+    used = 1;
+    size_t n = GetVarint(p + used, left - used, value);
+    if (n == 0)
+        throw std::string("Truncated trace record");
+    event.lobbyId = (int)value;
+    used += n;
+
+    switch (event.type)
+    {
+    case LobbyEvent::Join:
+    case LobbyEvent::Resume:
+        n = GetVarint(p + used, left - used, value);
+        if (n == 0)
+            throw std::string("Truncated trace record");
+        event.session = value;
+        used += n;
+        break;
+    case LobbyEvent::Choose:
+        if (left - used < 2)
+            throw std::string("Truncated trace record");
+        event.playerId = (uint8_t)p[used];
+        event.move = (Move)p[used + 1];
+        used += 2;
+        break;
+    case LobbyEvent::Leave:
+    case LobbyEvent::Disconnect:
+        if (left - used < 1)
+            throw std::string("Truncated trace record");
+        event.playerId = (uint8_t)p[used];
+        used += 1;
+        break;
+    case LobbyEvent::Resolve:
+        break;
+    default:
+        throw std::string("Unknown trace record type");
+    }
+    position += used;
+    return true;
+}
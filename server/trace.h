@@ -0,0 +1,55 @@
+#ifndef TRACE_H
+#define TRACE_H
+#include <stdio.h>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "lobbyengine.h"
+
+// Binary lobby event traces.
+//
+//     header:  "RPSTRACE" version (1 byte)
+//     record:  type (1 byte) | lobby id (varint) | body
+//     body:    Join, Resume        session (varint)
+//              Choose              player id (1 byte), move (1 byte)
+//              Leave, Disconnect   player id (1 byte)
+//              Resolve             (empty)
+//
+// Records appear in the order the lobbies applied them, which is all a replay
+// needs to reproduce a run.
+const uint8_t TraceVersion = 1;
+
+void EncodeEvent(std::vector<char> & out, LobbyEvent const & event);
+
+// Appends events from every lobby thread to one file. Records are batched in
+// memory and written out in large chunks.
+class TraceRecorder
+{
+private:
+    std::mutex recorderMutex;
+    FILE * file;
+    std::vector<char> buffer;
+    size_t recorded;
+    void WriteBuffer(void);
+public:
+    TraceRecorder(std::string const & path);
+    ~TraceRecorder(void);
+    void Record(LobbyEvent const & event);
+    void Flush(void);
+    size_t Recorded(void);
+};
+
+// Loads a whole trace into memory and hands the events back one at a time.
+class TraceReader
+{
+private:
+    std::vector<char> data;
+    size_t position;
+public:
+    TraceReader(std::string const & path);
+    // Returns false at the end of the trace; throws std::string if it is corrupt.
+    bool Next(LobbyEvent & event);
+};
+
+#endif // TRACE_H